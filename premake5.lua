@@ -6,9 +6,13 @@ workspace (projectName)
     architecture "x86"
     startproject (projectName)
 
+    -- SSE2 doubles instead of x87's 80-bit registers, the double-double arithmetic needs every operation rounded to a double
+    buildoptions { "-msse2", "-mfpmath=sse" }
+
 project (projectName)
     kind "ConsoleApp"
     language "C++"
+    cppdialect "C++17"
     targetdir ("build/%{cfg.buildcfg}")
 
     files {
@@ -17,6 +21,14 @@ project (projectName)
         "src/shaders/RayTracing.frag"
     }
 
+    -- Batch tools have their own entry points
+    removefiles { "src/headless/**", "src/tools/**" }
+
+    -- Shader sources are compiled into the executable
+    -- embedShaders is built for the same system into the same folder, so it has this project's extension (.exe on Windows)
+    dependson { "embedShaders" }
+    prebuildcommands { "%{cfg.targetdir}/embedShaders%{cfg.buildtarget.extension} obj/generated/embeddedShaders.h src/shaders/quad.vert src/shaders/quad.frag src/shaders/main.frag" }
+
     includedirs {
         "include",
         "include/GLFW",
@@ -24,6 +36,7 @@ project (projectName)
         "include/KHR",
         "include/imgui",
         "include/glm",
+        "obj/generated",
     }
 
     libdirs { "libs", "libs/GLFW" }
@@ -44,3 +57,87 @@ project (projectName)
     filter "configurations:Release"
         defines { "NDEBUG" }
         optimize "On"
+
+-- Headless batch renderer, CPU engine only (no GLFW, GLAD or ImGui)
+project "headless"
+    kind "ConsoleApp"
+    language "C++"
+    cppdialect "C++17"
+    targetdir ("build/%{cfg.buildcfg}")
+
+    files {
+        "src/*.h",
+        "src/headless/**.cpp"
+    }
+
+    includedirs {
+        "include",
+        "include/glm",
+        "src",
+    }
+
+    links { "m", "pthread", "z" }
+
+    filter "configurations:Debug"
+        defines { "DEBUG" }
+        symbols "On"
+        buildoptions { "-g" }
+
+    filter "configurations:Release"
+        defines { "NDEBUG" }
+        optimize "On"
+
+-- Build step writing the shaders into a header for the viewer
+project "embedShaders"
+    kind "ConsoleApp"
+    language "C++"
+    cppdialect "C++17"
+    targetdir ("build/%{cfg.buildcfg}")
+
+    files { "src/tools/embedShaders.cpp" }
+
+    filter "configurations:Release"
+        defines { "NDEBUG" }
+        optimize "On"
+
+-- Headless GPU renderer, the viewer's shaders on an offscreen EGL context (Linux, Mesa's llvmpipe without a GPU)
+project "headlessGpu"
+    kind "ConsoleApp"
+    language "C++"
+    cppdialect "C++17"
+    targetdir ("build/%{cfg.buildcfg}")
+
+    files {
+        "src/*.h",
+        "src/headlessGpu/**.h",
+        "src/headlessGpu/**.cpp",
+        "libs/glad/glad.c"
+    }
+
+    includedirs {
+        "include",
+        "include/glad",
+        "include/KHR",
+        "include/imgui",
+        "include/glm",
+        "src",
+        "obj/generated",
+    }
+
+    dependson { "embedShaders" }
+    prebuildcommands { "%{cfg.targetdir}/embedShaders%{cfg.buildtarget.extension} obj/generated/embeddedShaders.h src/shaders/quad.vert src/shaders/quad.frag src/shaders/main.frag" }
+
+    links { "EGL", "GL", "m", "pthread", "z" }
+
+    -- EGL is only there on Linux, built 64-bit with glad compiled from source (libs/glad/glad.o is the viewer's 32-bit object)
+    filter "system:linux"
+        architecture "x86_64"
+
+    filter "configurations:Debug"
+        defines { "DEBUG" }
+        symbols "On"
+        buildoptions { "-g" }
+
+    filter "configurations:Release"
+        defines { "NDEBUG" }
+        optimize "On"
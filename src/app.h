@@ -12,13 +12,16 @@
 #include <stdio.h>
 #include <vector>
 #include <math.h>
+#include <chrono>
+#include <memory>
 #include <glm/glm.hpp>
 #include "debug.h"
 #include "utils.h"
 #include "shader.h"
+#include "programCache.h"
 #include "window.h"
-#include "fullQuad.h"
 #include "renderer.h"
+#include "renderThread.h"
 
 class App
 {
@@ -26,6 +29,8 @@ public:
 
     App(int windowWidth, int windowHeight)
     {
+        auto startTime = std::chrono::steady_clock::now();
+
         // GLFW
         glfwSetErrorCallback(errorCallBack);
         glfwInit();
@@ -43,6 +48,11 @@ public:
         glfwMakeContextCurrent(window);
         glfwSwapInterval(1);  // Enable vsync
 
+        // Hidden window whose context shares objects with the main one, for the render thread
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        renderContext = glfwCreateWindow(1, 1, "Render", NULL, window);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
         // Initialize GLAD
         gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
         
@@ -50,16 +60,25 @@ public:
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         
-        // Properties of the ImGui window containing the OpenGL texture (that we draw on)
-        sceneWindow = Window(windowWidth, windowHeight);
-
         initImGui();
-        quad.init();
-        renderer = Renderer(&sceneWindow);
+
+        // Linked programs from earlier runs skip compilation altogether
+        // The scene renders on its own thread, into textures of the size of the ImGui window showing them
+        programCache = std::unique_ptr<ProgramCache>(new ProgramCache("programCache"));
+        viewportSize = glm::ivec2(windowWidth, windowHeight);
+        renderThread.start(renderContext, viewportSize, programCache.get());
+
+        // A cold start compiles every program, a warm one loads them all from the cache
+        startupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        startupWarm = programCache->hitCount() > 0 && programCache->missCount() == 0;
+        printf("Startup: %.1f ms (%s, %d programs loaded from the binary cache, %d compiled)\n", startupMs, startupWarm ? "warm" : "cold", programCache->hitCount(), programCache->missCount());
     }
 
     ~App()
     {
+        renderThread.stop();
+        glfwDestroyWindow(renderContext);
+
         ImGui_ImplOpenGL3_Shutdown();
         ImGui_ImplGlfw_Shutdown();
         ImGui::DestroyContext();
@@ -73,47 +92,34 @@ public:
         while (!glfwWindowShouldClose(window))
         {
             beginFrame();
-            gui();
-
-            ImGui::Begin("Viewport", nullptr, ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
             {
-                pollEvents();
+                // The menus and input edit the renderer between the render thread's frames
+                auto lock = renderThread.lock();
+                gui();
 
-                // Get previous frame texture unit and bind it (this way we can use it in the scene shader)
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, sceneWindow.textures[!pingpong]);
-
-                // Bind and clear current frame buffer (this way anything we render gets rendered on this FBO's texture)
-                glBindFramebuffer(GL_FRAMEBUFFER, sceneWindow.FBOs[pingpong]);
-                glViewport(0, 0, sceneWindow.width, sceneWindow.height);
-                glClear(GL_COLOR_BUFFER_BIT);
-                
-                // Render the scene
-                renderer.renderScene(0, &quad);
-
-                // Unbind current FBO and previous texture
-                glBindFramebuffer(GL_FRAMEBUFFER, 0);
-                glBindTexture(GL_TEXTURE_2D, 0);
-                
-                // Display current texture on ImGui window
-                ImGui::ImageButton((void*)sceneWindow.textures[pingpong], ImVec2(sceneWindow.width, sceneWindow.height), ImVec2(0, 1), ImVec2(1, 0), 0);
-                
-                // Swap pingpong boolean for the next iteration
-                pingpong = !pingpong;
+                ImGui::Begin("Viewport", nullptr, ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
+                pollEvents();
             }
+
+            // Display the newest finished frame, stretched while a resize is on its way
+            const RenderThread::Frame &frame = renderThread.latestFrame();
+            ImGui::ImageButton((void*)(intptr_t)frame.texture, ImVec2(viewportSize.x, viewportSize.y), ImVec2(0, 1), ImVec2(1, 0), 0);
             ImGui::End();
             
             endFrame();
+            renderThread.frameDrawn();
         }
     }
 
 private:
 
     GLFWwindow *window;
-    FullQuad quad;
-    Window sceneWindow;
-    Renderer renderer;
-    bool pingpong = false;
+    GLFWwindow *renderContext;
+    RenderThread renderThread;
+    glm::ivec2 viewportSize;
+    std::unique_ptr<ProgramCache> programCache;
+    double startupMs = 0.0;
+    bool startupWarm = false;
 
 
     // * GUI
@@ -122,8 +128,12 @@ private:
     {
         ImGui::DockSpaceOverViewport(0, ImGui::GetMainViewport());
 
+        Renderer &renderer = renderThread.renderer();
+
         ImGui::Begin("Data");
         renderer.dataGui();
+        ImGui::Text("Startup: %.1f ms (%s)", startupMs, startupWarm ? "warm" : "cold");
+        ImGui::Text("Render thread: %.1f ms per frame", renderThread.frameMs());
         ImGui::End();
 
         ImGui::Begin("Rendering");
@@ -174,6 +184,7 @@ private:
 
     void pollEvents()
     {
+        Renderer &renderer = renderThread.renderer();
         static bool isMouseDragging = false;
         static ImVec2 lastMousePos, lastWindowSize;
         
@@ -187,13 +198,13 @@ private:
         bool windowChangedSize = windowSize.x != lastWindowSize.x || windowSize.y != lastWindowSize.y;
         if (windowChangedSize)
         {
-            sceneWindow.updateDimensions((int)windowSize.x, (int)windowSize.y);
-            renderer.setResolution(sceneWindow.resolution());
+            viewportSize = glm::ivec2((int)windowSize.x, (int)windowSize.y);
+            renderThread.resize(viewportSize);
         }
 
         // Check if cursor is inside window
         bool mouseInsideWindow = mousePosRelative.x >= 0 && mousePosRelative.x <= windowSize.x && mousePosRelative.y >= 0 && mousePosRelative.y <= windowSize.y;
-        renderer.setZoomOn(mouseInsideWindow, mousePos);
+        renderer.setZoomOn(mouseInsideWindow, mousePosRelative);
         if (!mouseInsideWindow)
         {
             isMouseDragging = false;
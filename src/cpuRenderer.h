@@ -0,0 +1,634 @@
+#ifndef CPU_RENDERER_H
+#define CPU_RENDERER_H
+
+#include <math.h>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
+#include <condition_variable>
+#include <glm/glm.hpp>
+#include "utils.h"
+#include "fractal.h"
+#include "tileCache.h"
+
+struct Tile
+{
+    int x, y, width, height;
+};
+
+// Where an image sits on a tile cache's world grid of pixels, tiles are only cached when `cache` is set
+struct CacheView
+{
+    TileCache *cache = nullptr;
+    uint64_t key = 0;                   // Hash of everything that affects pixels except their position
+    int64_t originX = 0, originY = 0;   // World pixel of image pixel (0, 0)
+};
+
+// Everything a job has accumulated so far, enough to carry on with it later (even in another process)
+struct RenderProgress
+{
+    Tile region = { 0, 0, 0, 0 };
+    std::vector<glm::vec4> accumulation;
+    std::vector<float> iterations;
+    std::vector<std::pair<Tile, int>> tilePasses;   // Passes already in the buffers, per tile
+};
+
+// Ring of tile sized slots in memory the consumer provides (e.g. a mapped pixel buffer), the workers write each tile
+// they commit into a free slot so the consumer can use it from there without copying it out of the buffers first
+// Slots go from free to written to collected, and are free again once the consumer releases them
+class TileStaging
+{
+public:
+
+    static constexpr int SLOT_PIXELS = 64*64;
+
+    // Accumulation values of a slot followed by its iteration counts, tightly packed rows of the tile's width
+    static constexpr size_t SLOT_BYTES = SLOT_PIXELS*(sizeof(glm::vec4) + sizeof(float));
+
+    // `memory` holds `slotCount` slots of SLOT_BYTES each
+    void reset(void *memory, int slotCount)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->memory = (uint8_t*)memory;
+        slots.assign(slotCount, Slot());
+        writtenSlots.clear();
+        freeSlots.clear();
+        for (int i = slotCount - 1; i >= 0; i--) freeSlots.push_back(i);
+    }
+
+    static size_t accumulationOffset(int slot) { return slot*SLOT_BYTES; }
+    static size_t iterationOffset(int slot) { return slot*SLOT_BYTES + SLOT_PIXELS*sizeof(glm::vec4); }
+
+    glm::vec4 *accumulation(int slot) { return (glm::vec4*)(memory + accumulationOffset(slot)); }
+    float *iterations(int slot) { return (float*)(memory + iterationOffset(slot)); }
+
+    // * Workers
+
+    // A free slot to write a tile into, -1 when the consumer still has them all
+    int acquire()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (freeSlots.empty()) return -1;
+        int slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+
+    // `slot` holds `tile`, its iteration counts too when `hasIterations` (they only change on the first pass)
+    void publish(int slot, const Tile &tile, bool hasIterations)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        slots[slot] = { tile, hasIterations };
+        writtenSlots.push_back(slot);
+    }
+
+    // Drops the tiles nobody collected yet, they belong to a view that is gone
+    void discard()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeSlots.insert(freeSlots.end(), writtenSlots.begin(), writtenSlots.end());
+        writtenSlots.clear();
+    }
+
+    // * Consumer
+
+    // Calls `f(slot, tile, hasIterations)` for every slot written since the last call, oldest first
+    // The slots stay the consumer's until it releases them
+    template <typename F>
+    void collect(F f)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int slot : writtenSlots) f(slot, slots[slot].tile, slots[slot].hasIterations);
+        writtenSlots.clear();
+    }
+
+    void release(int slot)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeSlots.push_back(slot);
+    }
+
+private:
+
+    struct Slot
+    {
+        Tile tile = { 0, 0, 0, 0 };
+        bool hasIterations = false;
+    };
+
+    std::mutex mutex;
+    uint8_t *memory = nullptr;
+    std::vector<Slot> slots;
+    std::vector<int> writtenSlots, freeSlots;
+};
+
+// Multithreaded tiled CPU renderer, accumulates samples the same way the GPU path does
+class CpuRenderer
+{
+public:
+
+    static constexpr int TILE_SIZE = 64;
+    static_assert(TILE_SIZE*TILE_SIZE == TileStaging::SLOT_PIXELS, "Staging slots hold one tile");
+
+    CpuRenderer(int threadCount = 0)
+    {
+        if (threadCount <= 0) threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+
+        for (int i = 0; i < threadCount; i++)
+        {
+            workers.emplace_back(&CpuRenderer::workerLoop, this);
+        }
+    }
+
+    ~CpuRenderer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            generation++;
+        }
+        wake.notify_all();
+
+        for (std::thread &worker : workers) worker.join();
+    }
+
+    void start(const Fractal::Params &newParams, int newMaxPasses)
+    {
+        start(newParams, newMaxPasses, { 0, 0, newParams.resolution.x, newParams.resolution.y });
+    }
+
+    // Renders the whole image with tiles cut along `view`'s world grid, so they can be looked up and stored
+    // The view changes together with the job, no tile of the old one can be stored under the new view's keys
+    void startCached(const Fractal::Params &newParams, int newMaxPasses, const CacheView &view)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        begin(newParams, newMaxPasses, { 0, 0, newParams.resolution.x, newParams.resolution.y }, view);
+        wake.notify_all();
+    }
+
+    // Following tiles are also written into `staging`'s slots while there are free ones, nullptr to stop
+    // A previous staging has to stay alive until the workers are stopped, tiles in flight hand their slots back to it
+    void setStaging(TileStaging *newStaging)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        staging = newStaging;
+    }
+
+    // Renders only `newRegion` of the image, the buffers then cover just that region
+    void start(const Fractal::Params &newParams, int newMaxPasses, const Tile &newRegion)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        begin(newParams, newMaxPasses, newRegion);
+        wake.notify_all();
+    }
+
+    // Carries on with a job from a `snapshot` of it, tiles only render the passes they are missing
+    // The result matches an uninterrupted render since samples only depend on the pixel and the pass
+    void resume(const Fractal::Params &newParams, int newMaxPasses, const RenderProgress &progress)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        begin(newParams, newMaxPasses, progress.region);
+
+        accumulationBuffer = progress.accumulation;
+        iterationBuffer = progress.iterations;
+        pass = newMaxPasses;
+        for (const auto &tile : progress.tilePasses) tilePasses[position(tile.first)] = tile.second;
+        for (const Tile &tile : tiles) pass = std::min(pass, passesOf(tile));
+
+        if (pass >= maxPasses) done.notify_all();
+        else wake.notify_all();
+    }
+
+    // Copies out what the current job has accumulated so far, only holding up the workers for the copy
+    void snapshot(RenderProgress &progress)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        progress.region = region;
+        progress.accumulation = accumulationBuffer;
+        progress.iterations = iterationBuffer;
+        progress.tilePasses.clear();
+        for (const Tile &tile : tiles) progress.tilePasses.push_back({ tile, passesOf(tile) });
+    }
+
+    void setFocus(const std::vector<glm::vec2> &points)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // Only reorder when a focus point moved by at least a tile
+        bool moved = points.size() != focusPoints.size();
+        for (int i = 0; !moved && i < (int)points.size(); i++)
+        {
+            glm::vec2 delta = points[i] - focusPoints[i];
+            moved = fabsf(delta.x) >= TILE_SIZE || fabsf(delta.y) >= TILE_SIZE;
+        }
+        if (!moved) return;
+
+        focusPoints = points;
+        orderTiles(nextTile);
+    }
+
+    // Calls `f(tile, accumulation, iterations)` for every tile completed since the last call
+    // Tiles are in image coordinates, both buffers are row-major over the region (`region().width` stride)
+    template <typename F>
+    void collectCompletedTiles(F f)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const Tile &tile : completedTiles)
+        {
+            f(tile, accumulationBuffer.data(), iterationBuffer.data());
+        }
+        completedTiles.clear();
+    }
+
+    // As above, but tiles that went into staging slots come first, as `staged(slot, tile, hasIterations)`
+    // The buffers passed to `f` hold the newest values, so they never undo a staged tile of the same position
+    template <typename S, typename F>
+    void collectCompletedTiles(S staged, F f)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (staging) staging->collect(staged);
+        for (const Tile &tile : completedTiles)
+        {
+            f(tile, accumulationBuffer.data(), iterationBuffer.data());
+        }
+        completedTiles.clear();
+    }
+
+    // Blocks until every pass of the current job has finished
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return pass >= maxPasses; });
+    }
+
+    int passesCompleted()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pass;
+    }
+
+    int threadCount() const { return (int)workers.size(); }
+    glm::ivec2 resolution() const { return params ? params->resolution : glm::ivec2(0); }
+    Tile currentRegion() const { return region; }
+
+    // Only safe to read once `wait()` has returned
+    const std::vector<glm::vec4> &accumulation() const { return accumulationBuffer; }
+    const std::vector<float> &iterations() const { return iterationBuffer; }
+
+    // Moves the finished buffers out so the next job can start while they are being used
+    void takeResult(std::vector<glm::vec4> &accumulation, std::vector<float> &iterations)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        accumulation.swap(accumulationBuffer);
+        iterations.swap(iterationBuffer);
+    }
+
+private:
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    bool stopping = false;
+    std::atomic<int> generation { 0 };
+
+    // Current job, guarded by `mutex`
+    std::shared_ptr<const Fractal::Params> params;
+    Tile region = { 0, 0, 0, 0 };
+    std::vector<Tile> tiles;
+    std::vector<glm::vec2> focusPoints;
+    int maxPasses = 0;
+    int pass = 0;
+    int nextTile = 0;
+    int tilesDone = 0;
+
+    std::vector<glm::vec4> accumulationBuffer;
+    std::vector<float> iterationBuffer;
+    std::vector<Tile> completedTiles;
+    TileStaging *staging = nullptr;
+
+    // Tile cache, and how many passes each tile (by position) has in the buffers
+    // Tiles from the cache or a resumed job can be ahead of `pass`, their missing passes are skipped
+    CacheView cacheView;
+    std::unordered_map<uint64_t, int> tilePasses;
+
+    static int64_t floorMod(int64_t a, int64_t b)
+    {
+        return ((a % b) + b) % b;
+    }
+
+    static uint64_t position(const Tile &tile)
+    {
+        return (uint64_t)(uint32_t)tile.x << 32 | (uint32_t)tile.y;
+    }
+
+    int passesOf(const Tile &tile) const
+    {
+        auto found = tilePasses.find(position(tile));
+        return found == tilePasses.end() ? 0 : found->second;
+    }
+
+    // Only whole grid tiles get cached, partial ones at the image edges would clash with their neighbours' views
+    bool cacheable(const Tile &tile) const
+    {
+        return cacheView.cache && tile.width == TILE_SIZE && tile.height == TILE_SIZE;
+    }
+
+    uint64_t cacheKey(const Tile &tile) const
+    {
+        // Cacheable tiles start on a grid line, so this is exact
+        int64_t gridX = (cacheView.originX + tile.x - floorMod(cacheView.originX + tile.x, TILE_SIZE)) / TILE_SIZE;
+        int64_t gridY = (cacheView.originY + tile.y - floorMod(cacheView.originY + tile.y, TILE_SIZE)) / TILE_SIZE;
+        return hashValue(gridY, hashValue(gridX, cacheView.key));
+    }
+
+    // Sets up a new job, the caller holds the lock and wakes the workers
+    void begin(const Fractal::Params &newParams, int newMaxPasses, const Tile &newRegion, const CacheView &view = CacheView())
+    {
+        // Any tile still in flight belongs to the old view and gets discarded
+        generation++;
+        cacheView = view;
+        // Params that come with their reference orbit were prepared by the caller, away from the lock
+        params = std::make_shared<const Fractal::Params>(newParams.referenceOrbit ? newParams : Fractal::prepared(newParams));
+        region = newRegion;
+        maxPasses = newMaxPasses;
+        pass = 0;
+        nextTile = 0;
+        tilesDone = 0;
+
+        accumulationBuffer.assign(region.width*region.height, glm::vec4(0.0f));
+        iterationBuffer.assign(region.width*region.height, 0.0f);
+        completedTiles.clear();
+        if (staging) staging->discard();
+
+        // Split the region into tiles, lined up with the cache's grid when there is one
+        tiles.clear();
+        tilePasses.clear();
+        int right = region.x + region.width, top = region.y + region.height;
+        int offsetX = cacheView.cache ? (int)floorMod(cacheView.originX + region.x, TILE_SIZE) : 0;
+        int offsetY = cacheView.cache ? (int)floorMod(cacheView.originY + region.y, TILE_SIZE) : 0;
+        for (int y = region.y - offsetY; y < top; y += TILE_SIZE)
+        {
+            for (int x = region.x - offsetX; x < right; x += TILE_SIZE)
+            {
+                int tileX = std::max(x, region.x), tileY = std::max(y, region.y);
+                tiles.push_back({ tileX, tileY, std::min(x + TILE_SIZE, right) - tileX, std::min(y + TILE_SIZE, top) - tileY });
+            }
+        }
+        orderTiles(0);
+
+        // An empty region is finished before it starts, no worker would ever complete its passes
+        if (tiles.empty())
+        {
+            pass = maxPasses;
+            done.notify_all();
+        }
+    }
+
+    void orderTiles(int first)
+    {
+        if (focusPoints.empty() || first >= (int)tiles.size()) return;
+
+        // Rings of tiles around the nearest focus point, ordered by angle within a ring, spiral outwards
+        auto priority = [this](const Tile &tile)
+        {
+            glm::vec2 centre(tile.x + tile.width / 2.0f, tile.y + tile.height / 2.0f);
+            glm::vec2 nearest = focusPoints[0];
+            float nearestDistance = INFINITY;
+            for (const glm::vec2 &point : focusPoints)
+            {
+                glm::vec2 delta = centre - point;
+                float distance = glm::max(fabsf(delta.x), fabsf(delta.y));
+                if (distance < nearestDistance)
+                {
+                    nearestDistance = distance;
+                    nearest = point;
+                }
+            }
+            float ring = floorf(nearestDistance / TILE_SIZE);
+            return ring*8.0f + atan2f(centre.y - nearest.y, centre.x - nearest.x) + (float)PI;
+        };
+
+        std::vector<std::pair<float, Tile>> keyed;
+        for (int i = first; i < (int)tiles.size(); i++) keyed.push_back({ priority(tiles[i]), tiles[i] });
+        std::stable_sort(keyed.begin(), keyed.end(), [](const std::pair<float, Tile> &a, const std::pair<float, Tile> &b) { return a.first < b.first; });
+        for (int i = first; i < (int)tiles.size(); i++) tiles[i] = keyed[i - first].second;
+    }
+
+    void workerLoop()
+    {
+        std::vector<glm::vec4> tileAccumulation, previousAccumulation;
+        std::vector<float> tileIterations;
+        TileCache::Entry cachedTile;
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (true)
+        {
+            wake.wait(lock, [this] { return stopping || (pass < maxPasses && nextTile < (int)tiles.size()); });
+            if (stopping) return;
+
+            // Claim the next tile in priority order
+            int tileGeneration = generation;
+            int tilePass = pass;
+            Tile tile = tiles[nextTile++];
+            std::shared_ptr<const Fractal::Params> tileParams = params;
+            TileStaging *tileStaging = staging;
+            bool useCache = cacheable(tile);
+            TileCache *cache = cacheView.cache;
+            uint64_t key = useCache ? cacheKey(tile) : 0;
+
+            // Passes that came out of the cache or a snapshot are already in the buffers
+            if (tilePass < passesOf(tile))
+            {
+                finishTile();
+                continue;
+            }
+
+            // A staged tile holds the sum of all its passes, the ones so far are copied out while the lock is held anyway
+            previousAccumulation.clear();
+            if (tileStaging && tilePass > 0) readAccumulation(tile, previousAccumulation);
+
+            // First time round, see whether the cache has the tile
+            if (useCache && tilePass == 0)
+            {
+                lock.unlock();
+                bool hit = cache->get(key, cachedTile) && cachedTile.width == tile.width && cachedTile.height == tile.height;
+                int slot = hit ? stageTile(tileStaging, tile, 0, previousAccumulation, cachedTile.accumulation, cachedTile.iterations) : -1;
+                lock.lock();
+
+                if (generation != tileGeneration)
+                {
+                    if (slot >= 0) tileStaging->release(slot);
+                    continue;
+                }
+                if (hit)
+                {
+                    commitTile(tile, 0, cachedTile.accumulation, cachedTile.iterations, tileStaging, slot);
+                    tilePasses[position(tile)] = cachedTile.passes;
+                    finishTile();
+                    continue;
+                }
+            }
+
+            lock.unlock();
+            bool finished = renderTile(*tileParams, tile, tilePass, tileGeneration, tileAccumulation, tileIterations);
+            int slot = finished ? stageTile(tileStaging, tile, tilePass, previousAccumulation, tileAccumulation, tileIterations) : -1;
+            lock.lock();
+
+            // Drop the tile if the view changed while it was rendering
+            if (!finished || generation != tileGeneration)
+            {
+                if (slot >= 0) tileStaging->release(slot);
+                continue;
+            }
+
+            commitTile(tile, tilePass, tileAccumulation, tileIterations, tileStaging, slot);
+            int passes = tilePass + 1;
+            tilePasses[position(tile)] = passes;
+
+            // Store the tile every time its pass count doubles, so revisits get better and better starting points
+            bool store = useCache && (passes & (passes - 1)) == 0;
+            if (store) copyTile(tile, passes, cachedTile);
+
+            finishTile();
+
+            if (store)
+            {
+                lock.unlock();
+                cache->put(key, cachedTile);
+                lock.lock();
+            }
+        }
+    }
+
+    void finishTile()
+    {
+        // Start the next pass once every tile of this one is in
+        if (++tilesDone == (int)tiles.size())
+        {
+            pass++;
+            nextTile = 0;
+            tilesDone = 0;
+            orderTiles(0);
+
+            if (pass >= maxPasses) done.notify_all();
+            else wake.notify_all();
+        }
+    }
+
+    void copyTile(const Tile &tile, int passes, TileCache::Entry &entry) const
+    {
+        entry.passes = passes;
+        entry.width = tile.width;
+        entry.height = tile.height;
+        entry.accumulation.resize(tile.width*tile.height);
+        entry.iterations.resize(tile.width*tile.height);
+
+        for (int j = 0; j < tile.height; j++)
+        {
+            int index = (tile.y - region.y + j)*region.width + tile.x - region.x;
+            std::copy_n(&accumulationBuffer[index], tile.width, &entry.accumulation[j*tile.width]);
+            std::copy_n(&iterationBuffer[index], tile.width, &entry.iterations[j*tile.width]);
+        }
+    }
+
+    void readAccumulation(const Tile &tile, std::vector<glm::vec4> &accumulation) const
+    {
+        accumulation.resize(tile.width*tile.height);
+        for (int j = 0; j < tile.height; j++)
+        {
+            int index = (tile.y - region.y + j)*region.width + tile.x - region.x;
+            std::copy_n(&accumulationBuffer[index], tile.width, &accumulation[j*tile.width]);
+        }
+    }
+
+    bool renderTile(const Fractal::Params &tileParams, const Tile &tile, int tilePass, int tileGeneration, std::vector<glm::vec4> &tileAccumulation, std::vector<float> &tileIterations)
+    {
+        tileAccumulation.resize(tile.width*tile.height);
+        tileIterations.resize(tile.width*tile.height);
+
+        // A row at a time, so the SIMD kernel pairs samples of neighbouring pixels (see Fractal::ColourSum)
+        glm::vec3 sums[TILE_SIZE];
+        float sampleCounts[TILE_SIZE];
+        glm::vec2 centres[TILE_SIZE];
+        int centreIterations[TILE_SIZE];
+
+        for (int j = 0; j < tile.height; j++)
+        {
+            // Bail out early on deep tiles that are no longer wanted
+            if (generation != tileGeneration) return false;
+
+            int y = tile.y + j;
+            Fractal::ColourSum colours(tileParams, sums);
+            for (int i = 0; i < tile.width; i++)
+            {
+                sums[i] = glm::vec3(0.0f);
+                sampleCounts[i] = Fractal::forEachSample(tileParams, tile.x + i, y, tilePass, [&](glm::vec2 coord) { colours.add(i, coord); });
+            }
+            colours.flush();
+
+            for (int i = 0; i < tile.width; i++)
+            {
+                glm::vec3 colour = sums[i] / sampleCounts[i];
+                if (tileParams.doGammaCorrection) colour = Fractal::gammaCorrect(colour);
+
+                // Weight the colour by the number of samples it averages, alpha holds the sample count
+                tileAccumulation[j*tile.width + i] = glm::vec4(colour*sampleCounts[i], sampleCounts[i]);
+            }
+
+            // Single centre sample iteration count, used by the denoiser
+            if (tilePass == 0)
+            {
+                for (int i = 0; i < tile.width; i++) centres[i] = glm::vec2(tile.x + i + 1.0f, y + 1.0f);
+                Fractal::calculateIterations(tileParams, centres, tile.width, centreIterations);
+                for (int i = 0; i < tile.width; i++) tileIterations[j*tile.width + i] = (float)centreIterations[i];
+            }
+        }
+
+        return true;
+    }
+
+    // Writes a finished tile into a free slot of `tileStaging` without holding the lock, -1 when there is none
+    // `previous` holds what the tile accumulated before this pass, empty on the first one
+    static int stageTile(TileStaging *tileStaging, const Tile &tile, int tilePass, const std::vector<glm::vec4> &previous, const std::vector<glm::vec4> &tileAccumulation, const std::vector<float> &tileIterations)
+    {
+        int slot = tileStaging ? tileStaging->acquire() : -1;
+        if (slot < 0) return -1;
+
+        glm::vec4 *stagedAccumulation = tileStaging->accumulation(slot);
+        int pixels = tile.width*tile.height;
+        if (previous.empty()) std::copy_n(tileAccumulation.data(), pixels, stagedAccumulation);
+        else for (int i = 0; i < pixels; i++) stagedAccumulation[i] = previous[i] + tileAccumulation[i];
+        if (tilePass == 0) std::copy_n(tileIterations.data(), pixels, tileStaging->iterations(slot));
+        return slot;
+    }
+
+    // Adds a finished tile to the buffers and queues it for the consumer, as the `slot` it was staged in unless staging
+    // changed meanwhile. The caller holds the lock
+    void commitTile(const Tile &tile, int tilePass, const std::vector<glm::vec4> &tileAccumulation, const std::vector<float> &tileIterations, TileStaging *tileStaging, int slot)
+    {
+        for (int j = 0; j < tile.height; j++)
+        {
+            for (int i = 0; i < tile.width; i++)
+            {
+                int index = (tile.y - region.y + j)*region.width + tile.x - region.x + i;
+                accumulationBuffer[index] += tileAccumulation[j*tile.width + i];
+                if (tilePass == 0) iterationBuffer[index] = tileIterations[j*tile.width + i];
+            }
+        }
+
+        if (slot >= 0 && tileStaging == staging)
+        {
+            staging->publish(slot, tile, tilePass == 0);
+            return;
+        }
+        if (slot >= 0) tileStaging->release(slot);
+        completedTiles.push_back(tile);
+    }
+
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include <vector>
+#include <math.h>
+#include <glm/glm.hpp>
+
+// Edge-aware spatial denoiser for progressive frames (CPU mirror of the filter in quad.frag)
+namespace Denoise
+{
+    struct Settings
+    {
+        bool enabled = false;
+        int radius = 2;
+        float colourSigma = 0.25f;
+        float iterationSigma = 1.0f;
+        float fadeFrames = 64.0f;   // Accumulated frames at which the filter has completely faded out
+    };
+
+    inline glm::vec3 resolve(const glm::vec4 &accumulated)
+    {
+        // RGB is the sum of all accumulated samples and alpha is the sample count
+        return glm::vec3(accumulated) / glm::max(accumulated.a, 1.0f);
+    }
+
+    // How much of the plain accumulated colour shows after `frames` frames, the fade goes by frames rather than by the
+    // pixel's sample count since edge-directed sampling leaves flat pixels at one sample however long it runs
+    inline float fade(int frames, const Settings &settings)
+    {
+        return glm::clamp(frames / settings.fadeFrames, 0.0f, 1.0f);
+    }
+
+    inline glm::vec3 jointBilateral(const std::vector<glm::vec4> &accumulation, const std::vector<float> &iterations, glm::ivec2 resolution, int x, int y, int frames, const Settings &settings)
+    {
+        glm::vec4 centreAccumulated = accumulation[y*resolution.x + x];
+        glm::vec3 centreColour = resolve(centreAccumulated);
+        if (!settings.enabled) return centreColour;
+
+        float centreIteration = iterations[y*resolution.x + x];
+        float spatialSigma = glm::max(settings.radius / 2.0f, 0.5f);
+
+        glm::vec3 colourSum(0.0f);
+        float weightSum = 0.0f;
+
+        for (int j = -settings.radius; j <= settings.radius; j++)
+        {
+            for (int i = -settings.radius; i <= settings.radius; i++)
+            {
+                int nx = glm::clamp(x + i, 0, resolution.x - 1);
+                int ny = glm::clamp(y + j, 0, resolution.y - 1);
+
+                glm::vec3 colour = resolve(accumulation[ny*resolution.x + nx]);
+                float iterationDelta = iterations[ny*resolution.x + nx] - centreIteration;
+                glm::vec3 colourDelta = colour - centreColour;
+
+                // Spatial falloff, stop at iteration band edges and strong colour changes
+                float weight = expf(-(i*i + j*j) / (2.0f*spatialSigma*spatialSigma))
+                    * expf(-(iterationDelta*iterationDelta) / (2.0f*settings.iterationSigma*settings.iterationSigma))
+                    * expf(-glm::dot(colourDelta, colourDelta) / (2.0f*settings.colourSigma*settings.colourSigma));
+
+                colourSum += colour*weight;
+                weightSum += weight;
+            }
+        }
+
+        // Fade the filter out as frames accumulate
+        glm::vec3 denoised = colourSum / weightSum;
+        return glm::mix(denoised, centreColour, fade(frames, settings));
+    }
+
+    inline void jointBilateral(const std::vector<glm::vec4> &accumulation, const std::vector<float> &iterations, glm::ivec2 resolution, int frames, const Settings &settings, std::vector<glm::vec3> &output)
+    {
+        output.resize(resolution.x*resolution.y);
+        for (int y = 0; y < resolution.y; y++)
+        {
+            for (int x = 0; x < resolution.x; x++)
+            {
+                output[y*resolution.x + x] = jointBilateral(accumulation, iterations, resolution, x, y, frames, settings);
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef DOUBLE_DOUBLE_H
+#define DOUBLE_DOUBLE_H
+
+#include <math.h>
+#include <ctype.h>
+#include <string>
+
+// Unevaluated sum of two doubles, about 106 bits of mantissa (Dekker, Knuth, and the QD library's "sloppy" operations)
+// The error-free transformations need IEEE double rounding on every operation: SSE2 math on 32-bit x86, no -ffast-math
+struct DoubleDouble
+{
+    double hi = 0.0, lo = 0.0;
+
+    DoubleDouble() {}
+    DoubleDouble(double value) : hi(value) {}
+    DoubleDouble(double high, double low) : hi(high), lo(low) {}
+
+    double value() const { return hi + lo; }
+};
+
+namespace DD
+{
+    // a + b exactly, for any a and b
+    inline DoubleDouble twoSum(double a, double b)
+    {
+        double s = a + b;
+        double bb = s - a;
+        return DoubleDouble(s, (a - (s - bb)) + (b - bb));
+    }
+
+    // a + b exactly when |a| >= |b|
+    inline DoubleDouble quickTwoSum(double a, double b)
+    {
+        double s = a + b;
+        return DoubleDouble(s, b - (s - a));
+    }
+
+    // a*b exactly, with a fused multiply-add where there is one and Dekker's splitting otherwise
+    inline DoubleDouble twoProduct(double a, double b)
+    {
+        double p = a*b;
+#ifdef __FMA__
+        return DoubleDouble(p, fma(a, b, -p));
+#else
+        const double SPLIT = 134217729.0;  // 2^27 + 1
+        double ta = SPLIT*a, tb = SPLIT*b;
+        double aHigh = ta - (ta - a), bHigh = tb - (tb - b);
+        double aLow = a - aHigh, bLow = b - bHigh;
+        return DoubleDouble(p, ((aHigh*bHigh - p) + aHigh*bLow + aLow*bHigh) + aLow*bLow);
+#endif
+    }
+
+    inline DoubleDouble add(DoubleDouble a, DoubleDouble b)
+    {
+        DoubleDouble s = twoSum(a.hi, b.hi);
+        return quickTwoSum(s.hi, s.lo + a.lo + b.lo);
+    }
+
+    inline DoubleDouble add(DoubleDouble a, double b)
+    {
+        DoubleDouble s = twoSum(a.hi, b);
+        return quickTwoSum(s.hi, s.lo + a.lo);
+    }
+
+    inline DoubleDouble negate(DoubleDouble a)
+    {
+        return DoubleDouble(-a.hi, -a.lo);
+    }
+
+    inline DoubleDouble sub(DoubleDouble a, DoubleDouble b)
+    {
+        return add(a, negate(b));
+    }
+
+    inline DoubleDouble mul(DoubleDouble a, DoubleDouble b)
+    {
+        DoubleDouble p = twoProduct(a.hi, b.hi);
+        return quickTwoSum(p.hi, p.lo + (a.hi*b.lo + a.lo*b.hi));
+    }
+
+    inline DoubleDouble mul(DoubleDouble a, double b)
+    {
+        DoubleDouble p = twoProduct(a.hi, b);
+        return quickTwoSum(p.hi, p.lo + a.lo*b);
+    }
+
+    inline DoubleDouble sqr(DoubleDouble a)
+    {
+        DoubleDouble p = twoProduct(a.hi, a.hi);
+        return quickTwoSum(p.hi, p.lo + 2.0*a.hi*a.lo);
+    }
+
+    // Exact, scaling by a power of two never rounds
+    inline DoubleDouble twice(DoubleDouble a)
+    {
+        return DoubleDouble(2.0*a.hi, 2.0*a.lo);
+    }
+
+    inline DoubleDouble div(DoubleDouble a, double b)
+    {
+        // Long division, one correction step per half
+        double q1 = a.hi / b;
+        DoubleDouble r = sub(a, twoProduct(q1, b));
+        double q2 = r.hi / b;
+        r = sub(r, twoProduct(q2, b));
+        return add(quickTwoSum(q1, q2), r.hi / b);
+    }
+
+    // Decimal number (sign, digits, optional fraction and exponent) to the nearest double-double, false if `text` isn't one
+    inline bool parse(const std::string &text, DoubleDouble &value)
+    {
+        size_t i = 0;
+        bool negative = i < text.size() && (text[i] == '-' || text[i] == '+') && text[i++] == '-';
+
+        // Digits go into the mantissa exactly (up to 32 of them), the decimal point just shifts the exponent
+        DoubleDouble mantissa;
+        int exponent = 0, digits = 0;
+        bool point = false;
+        for (; i < text.size() && (isdigit((unsigned char)text[i]) || (text[i] == '.' && !point)); i++)
+        {
+            if (text[i] == '.') { point = true; continue; }
+            mantissa = add(mul(mantissa, 10.0), (double)(text[i] - '0'));
+            exponent -= point;
+            digits++;
+        }
+        if (digits == 0) return false;
+
+        if (i < text.size() && (text[i] == 'e' || text[i] == 'E'))
+        {
+            size_t end = 0;
+            try { exponent += std::stoi(text.substr(i + 1), &end); }
+            catch (...) { return false; }
+            if (end == 0) return false;
+            i += 1 + end;
+        }
+        if (i != text.size()) return false;
+
+        for (; exponent > 0; exponent--) mantissa = mul(mantissa, 10.0);
+        for (; exponent < 0; exponent++) mantissa = div(mantissa, 10.0);
+        value = negative ? negate(mantissa) : mantissa;
+        return true;
+    }
+}
+
+// Two double-doubles side by side, one per SIMD lane (SSE2 on x86, plain scalar code where there's no vector unit)
+// Every lane goes through exactly the operations of the scalar versions above, so results match them bit for bit
+typedef double Double2 __attribute__((vector_size(16)));
+typedef long long Mask2 __attribute__((vector_size(16)));
+
+struct DoubleDouble2
+{
+    Double2 hi = {}, lo = {};
+
+    DoubleDouble2() {}
+    explicit DoubleDouble2(double value) : hi(Double2{ value, value }) {}
+    DoubleDouble2(Double2 high, Double2 low) : hi(high), lo(low) {}
+    DoubleDouble2(DoubleDouble a, DoubleDouble b) : hi(Double2{ a.hi, b.hi }), lo(Double2{ a.lo, b.lo }) {}
+
+    DoubleDouble lane(int i) const { return DoubleDouble(hi[i], lo[i]); }
+};
+
+namespace DD
+{
+    inline DoubleDouble2 twoSum(Double2 a, Double2 b)
+    {
+        Double2 s = a + b;
+        Double2 bb = s - a;
+        return DoubleDouble2(s, (a - (s - bb)) + (b - bb));
+    }
+
+    inline DoubleDouble2 quickTwoSum(Double2 a, Double2 b)
+    {
+        Double2 s = a + b;
+        return DoubleDouble2(s, b - (s - a));
+    }
+
+    inline DoubleDouble2 twoProduct(Double2 a, Double2 b)
+    {
+        Double2 p = a*b;
+        const Double2 SPLIT = { 134217729.0, 134217729.0 };
+        Double2 ta = SPLIT*a, tb = SPLIT*b;
+        Double2 aHigh = ta - (ta - a), bHigh = tb - (tb - b);
+        Double2 aLow = a - aHigh, bLow = b - bHigh;
+        return DoubleDouble2(p, ((aHigh*bHigh - p) + aHigh*bLow + aLow*bHigh) + aLow*bLow);
+    }
+
+    inline DoubleDouble2 add(DoubleDouble2 a, DoubleDouble2 b)
+    {
+        DoubleDouble2 s = twoSum(a.hi, b.hi);
+        return quickTwoSum(s.hi, s.lo + a.lo + b.lo);
+    }
+
+    inline DoubleDouble2 sub(DoubleDouble2 a, DoubleDouble2 b)
+    {
+        return add(a, DoubleDouble2(-b.hi, -b.lo));
+    }
+
+    inline DoubleDouble2 mul(DoubleDouble2 a, DoubleDouble2 b)
+    {
+        DoubleDouble2 p = twoProduct(a.hi, b.hi);
+        return quickTwoSum(p.hi, p.lo + (a.hi*b.lo + a.lo*b.hi));
+    }
+
+    inline DoubleDouble2 sqr(DoubleDouble2 a)
+    {
+        DoubleDouble2 p = twoProduct(a.hi, a.hi);
+        return quickTwoSum(p.hi, p.lo + 2.0*a.hi*a.lo);
+    }
+
+    inline DoubleDouble2 twice(DoubleDouble2 a)
+    {
+        return DoubleDouble2(2.0*a.hi, 2.0*a.lo);
+    }
+
+    // Lanes of `a` where `mask` is set, of `b` elsewhere
+    inline DoubleDouble2 select(Mask2 mask, DoubleDouble2 a, DoubleDouble2 b)
+    {
+        return DoubleDouble2(mask ? a.hi : b.hi, mask ? a.lo : b.lo);
+    }
+}
+
+#endif
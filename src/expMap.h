@@ -0,0 +1,210 @@
+#ifndef EXP_MAP_H
+#define EXP_MAP_H
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "utils.h"
+#include "fractal.h"
+
+// Exponential map zoom videos, one log-polar strip along the whole zoom is rendered and every frame is resampled from it
+// The strip's pixels cover an equal angle and an equal step in log radius, so its cost only grows with log(zoom)
+namespace ExpMap
+{
+    // 8-bit RGB image with box filtered mip levels, rows bottom-up like the accumulation buffers
+    // It can hold just rows [firstRow, firstRow + size.y) of a taller image, rows outside those are clamped. Mip boxes
+    // line up with the full image's as long as `firstRow` is a multiple of their height
+    class Pyramid
+    {
+    public:
+
+        Pyramid(glm::ivec2 size = glm::ivec2(0), bool wrapX = false, int firstRow = 0)
+            : wrap(wrapX), origin(firstRow)
+        {
+            levels.push_back({ size, std::vector<uint8_t>((size_t)size.x*size.y*3) });
+        }
+
+        glm::ivec2 size() const { return levels[0].size; }
+        int firstRow() const { return origin; }
+        int endRow() const { return origin + levels[0].size.y; }
+        uint8_t *row(int y) { return &levels[0].rgb[(size_t)(y - origin)*levels[0].size.x*3]; }
+
+        // Call once level 0 is filled in
+        void build()
+        {
+            levels.resize(1);
+            while (levels.back().size.x > 1 || levels.back().size.y > 1)
+            {
+                const Level &fine = levels.back();
+                Level coarse = { glm::ivec2(std::max((fine.size.x + 1) / 2, 1), std::max((fine.size.y + 1) / 2, 1)), {} };
+                coarse.rgb.resize((size_t)coarse.size.x*coarse.size.y*3);
+
+                for (int y = 0; y < coarse.size.y; y++)
+                {
+                    for (int x = 0; x < coarse.size.x; x++)
+                    {
+                        glm::vec3 sum = texel(fine, 2*x, 2*y) + texel(fine, 2*x + 1, 2*y) + texel(fine, 2*x, 2*y + 1) + texel(fine, 2*x + 1, 2*y + 1);
+                        uint8_t *out = &coarse.rgb[((size_t)y*coarse.size.x + x)*3];
+                        for (int c = 0; c < 3; c++) out[c] = (uint8_t)(sum[c] / 4.0f + 0.5f);
+                    }
+                }
+                levels.push_back(std::move(coarse));
+            }
+        }
+
+        // Trilinear sample, `pixel` in level 0 pixels of the full image (centres on integers), `level` is log2 of the
+        // footprint in level 0 pixels
+        glm::vec3 sample(glm::vec2 pixel, float level) const
+        {
+            pixel.y -= origin;
+            level = glm::clamp(level, 0.0f, (float)(levels.size() - 1));
+            int fine = (int)level;
+            int coarse = std::min(fine + 1, (int)levels.size() - 1);
+
+            return glm::mix(bilinear(fine, pixel), bilinear(coarse, pixel), level - fine);
+        }
+
+    private:
+
+        struct Level
+        {
+            glm::ivec2 size;
+            std::vector<uint8_t> rgb;
+        };
+
+        std::vector<Level> levels;
+        bool wrap;
+        int origin;
+
+        glm::vec3 texel(const Level &level, int x, int y) const
+        {
+            x = wrap ? (x % level.size.x + level.size.x) % level.size.x : glm::clamp(x, 0, level.size.x - 1);
+            y = glm::clamp(y, 0, level.size.y - 1);
+            const uint8_t *p = &level.rgb[((size_t)y*level.size.x + x)*3];
+            return glm::vec3(p[0], p[1], p[2]);
+        }
+
+        glm::vec3 bilinear(int index, glm::vec2 pixel) const
+        {
+            const Level &level = levels[index];
+            glm::vec2 p = (pixel + 0.5f) / (float)(1 << index) - 0.5f;
+            int x = (int)floorf(p.x), y = (int)floorf(p.y);
+            glm::vec2 t = p - glm::vec2((float)x, (float)y);
+
+            return glm::mix(glm::mix(texel(level, x, y), texel(level, x + 1, y), t.x),
+                            glm::mix(texel(level, x, y + 1), texel(level, x + 1, y + 1), t.x), t.y);
+        }
+    };
+
+    // Strip covering every frame of a zoom into `target`, from `firstView` (outermost) to `lastView` (innermost)
+    // Whatever is inside the last view's inscribed circle comes from a conventional render of it, the centre patch
+    struct Layout
+    {
+        glm::dvec2 target;
+        double outerRadius, innerRadius;
+        Fractal::Params strip;
+    };
+
+    inline Layout layout(const Fractal::Params &firstView, const Fractal::Params &lastView)
+    {
+        Layout result;
+        glm::dvec2 size = glm::dvec2(firstView.resolution);
+        result.target = Fractal::planeCoords(lastView, glm::vec2(size / 2.0));
+
+        // Furthest corner of the first frame and nearest edge of the last one
+        result.outerRadius = 0.0;
+        for (glm::vec2 corner : { glm::vec2(0.0f), glm::vec2(size.x, 0.0), glm::vec2(0.0, size.y), glm::vec2(size) })
+        {
+            result.outerRadius = std::max(result.outerRadius, glm::length(Fractal::planeCoords(firstView, corner) - result.target));
+        }
+        result.innerRadius = std::min(
+            glm::length(Fractal::planeCoords(lastView, glm::vec2(size.x / 2.0, 0.0)) - result.target),
+            glm::length(Fractal::planeCoords(lastView, glm::vec2(0.0, size.y / 2.0)) - result.target));
+
+        // As many angles as the first frame has pixels around its outer edge, rounded to whole tiles so mip levels wrap cleanly
+        double pixelSize = firstView.dimensions.x / firstView.resolution.x;
+        int width = (int)ceil(2.0*PI*result.outerRadius / pixelSize / 64.0)*64;
+        double step = 2.0*PI / width;
+        int height = (int)ceil(log(result.outerRadius / result.innerRadius) / step) + 2;
+
+        result.strip = firstView;
+        result.strip.exponentialMap = true;
+        result.strip.centerCoords = result.target;
+        result.strip.mapRadius = result.outerRadius;
+        result.strip.resolution = glm::ivec2(width, height);
+
+        return result;
+    }
+
+    // Strip rows [x, y) that composing `view` reads, with room for the widest mip footprint it samples at. Only pixels
+    // closer to the target than a quarter pixel (the centre one at most) reach further, they read clamped rows
+    // A frame's rows only span the log of its size in pixels, however deep the zoom is
+    inline glm::ivec2 stripRows(const Layout &layout, const Fractal::Params &view)
+    {
+        double step = 2.0*PI / layout.strip.resolution.x;
+        glm::dvec2 size = glm::dvec2(view.resolution);
+        double pixelSize = view.dimensions.x / view.resolution.x;
+
+        double outer = 0.0;
+        for (glm::vec2 corner : { glm::vec2(0.0f), glm::vec2(size.x, 0.0), glm::vec2(0.0, size.y), glm::vec2(size) })
+        {
+            outer = std::max(outer, glm::length(Fractal::planeCoords(view, corner) - layout.target));
+        }
+        double inner = std::max(layout.innerRadius, pixelSize / 4.0);
+        double footprint = pixelSize / (inner*step);
+
+        int first = (int)floor(log(layout.outerRadius / outer) / step) - 2;
+        int last = (int)ceil(log(layout.outerRadius / inner) / step + footprint) + 2;
+        return glm::clamp(glm::ivec2(first, last), glm::ivec2(0), glm::ivec2(layout.strip.resolution.y));
+    }
+
+    // Resamples the rectangular `view` from the strip and centre patch into top-down RGB
+    inline void composeFrame(const Layout &layout, const Pyramid &strip, const Pyramid &patch, const Fractal::Params &lastView, const Fractal::Params &view, int threadCount, std::vector<uint8_t> &rgb)
+    {
+        glm::ivec2 resolution = view.resolution;
+        rgb.resize((size_t)resolution.x*resolution.y*3);
+
+        double step = 2.0*PI / layout.strip.resolution.x;
+        double pixelSize = view.dimensions.x / resolution.x;
+        float patchLevel = (float)log2(pixelSize / (lastView.dimensions.x / resolution.x));
+
+        auto composeRows = [&](int firstRow, int lastRow)
+        {
+            for (int y = firstRow; y < lastRow; y++)
+            {
+                uint8_t *row = &rgb[(size_t)(resolution.y - 1 - y)*resolution.x*3];
+                for (int x = 0; x < resolution.x; x++)
+                {
+                    // Same pixel centres as Fractal::forEachSample
+                    glm::dvec2 uv = Fractal::planeCoords(view, glm::vec2(x + 1.0f, y + 1.0f));
+                    glm::dvec2 offset = uv - layout.target;
+                    double radius = glm::length(offset);
+
+                    glm::vec3 colour;
+                    if (radius >= layout.innerRadius)
+                    {
+                        // Strip pixels shrink towards the centre, so pick the level where they match the screen's
+                        double angle = atan2(offset.y, offset.x);
+                        if (angle < 0.0) angle += 2.0*PI;
+                        glm::vec2 pixel((float)(angle / step - 1.0), (float)(log(layout.outerRadius / radius) / step - 1.0));
+                        float level = (float)log2(radius / pixelSize*step);
+                        colour = strip.sample(pixel, -level);
+                    }
+                    else
+                    {
+                        glm::vec2 pixel = glm::vec2(Fractal::screenCoords(lastView, uv)) - 1.0f;
+                        colour = patch.sample(pixel, patchLevel);
+                    }
+
+                    for (int c = 0; c < 3; c++) row[x*3 + c] = (uint8_t)(colour[c] + 0.5f);
+                }
+            }
+        };
+
+        parallelRows(resolution.y, threadCount, composeRows);
+    }
+}
+
+#endif
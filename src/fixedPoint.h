@@ -0,0 +1,149 @@
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#include <math.h>
+#include <stdint.h>
+#include "doubleDouble.h"
+
+// Signed 128-bit fixed-point number, two's complement with 7 integer and 120 fraction bits (range +-128, steps of 2^-120)
+// Integer arithmetic only, so results are the same bit for bit on every machine and compiler (products are truncated,
+// conversions from doubles are exact down to 2^-120)
+struct Fixed128
+{
+    uint64_t hi = 0, lo = 0;
+
+    Fixed128() {}
+    Fixed128(uint64_t high, uint64_t low) : hi(high), lo(low) {}
+
+    bool negative() const { return (hi >> 63) != 0; }
+};
+
+namespace Fixed
+{
+    const int FRACTION_BITS = 120;
+
+    // a*b as a 128-bit product split into halves, with the compiler's 128-bit integers where the target has them
+    inline void mulWide(uint64_t a, uint64_t b, uint64_t &high, uint64_t &low)
+    {
+#ifdef __SIZEOF_INT128__
+        unsigned __int128 p = (unsigned __int128)a*b;
+        high = (uint64_t)(p >> 64);
+        low = (uint64_t)p;
+#else
+        // Four 32x32 bit partial products, 32-bit targets multiply those natively
+        uint64_t a0 = (uint32_t)a, a1 = a >> 32, b0 = (uint32_t)b, b1 = b >> 32;
+        uint64_t p00 = a0*b0, p01 = a0*b1, p10 = a1*b0, p11 = a1*b1;
+        uint64_t middle = (p00 >> 32) + (uint32_t)p01 + (uint32_t)p10;
+        high = p11 + (p01 >> 32) + (p10 >> 32) + (middle >> 32);
+        low = (middle << 32) | (uint32_t)p00;
+#endif
+    }
+
+    inline Fixed128 add(Fixed128 a, Fixed128 b)
+    {
+        uint64_t low = a.lo + b.lo;
+        return Fixed128(a.hi + b.hi + (low < a.lo), low);
+    }
+
+    inline Fixed128 negate(Fixed128 a)
+    {
+        uint64_t low = ~a.lo + 1;
+        return Fixed128(~a.hi + (low == 0), low);
+    }
+
+    inline Fixed128 sub(Fixed128 a, Fixed128 b)
+    {
+        return add(a, negate(b));
+    }
+
+    inline Fixed128 twice(Fixed128 a)
+    {
+        return Fixed128((a.hi << 1) | (a.lo >> 63), a.lo << 1);
+    }
+
+    inline Fixed128 abs(Fixed128 a)
+    {
+        return a.negative() ? negate(a) : a;
+    }
+
+    // Product of two magnitudes, the 256-bit product shifted back down by the fraction bits (truncated)
+    inline Fixed128 mulUnsigned(Fixed128 a, Fixed128 b)
+    {
+        uint64_t h00, l00, h01, l01, h10, l10, h11, l11;
+        mulWide(a.lo, b.lo, h00, l00);
+        mulWide(a.lo, b.hi, h01, l01);
+        mulWide(a.hi, b.lo, h10, l10);
+        mulWide(a.hi, b.hi, h11, l11);
+
+        // Bits 64-255 of the product in r1..r3 (bits 0-63 are below the result)
+        uint64_t r1 = h00 + l01;
+        uint64_t carry = r1 < l01;
+        r1 += l10;
+        carry += r1 < l10;
+        uint64_t r2 = h01 + carry;
+        uint64_t r3 = r2 < carry;
+        r2 += h10;
+        r3 += r2 < h10;
+        r2 += l11;
+        r3 += (r2 < l11) + h11;
+
+        const int SHIFT = FRACTION_BITS - 64;
+        return Fixed128((r2 >> SHIFT) | (r3 << (64 - SHIFT)), (r1 >> SHIFT) | (r2 << (64 - SHIFT)));
+    }
+
+    inline Fixed128 mul(Fixed128 a, Fixed128 b)
+    {
+        Fixed128 p = mulUnsigned(abs(a), abs(b));
+        return a.negative() != b.negative() ? negate(p) : p;
+    }
+
+    inline Fixed128 sqr(Fixed128 a)
+    {
+        Fixed128 magnitude = abs(a);
+        return mulUnsigned(magnitude, magnitude);
+    }
+
+    // a > b for non-negative values
+    inline bool greater(Fixed128 a, Fixed128 b)
+    {
+        return a.hi > b.hi || (a.hi == b.hi && a.lo > b.lo);
+    }
+
+    inline Fixed128 fromInt(int value)
+    {
+        Fixed128 magnitude((uint64_t)(value < 0 ? -value : value) << (FRACTION_BITS - 64), 0);
+        return value < 0 ? negate(magnitude) : magnitude;
+    }
+
+    // Exact for every double in range down to 2^-120, the bits below that are dropped
+    // Callers keep |value| < 128, larger ones don't fit (see Fractal::fixedPointIteration)
+    inline Fixed128 fromDouble(double value)
+    {
+        if (value == 0.0) return Fixed128();
+
+        int exponent;
+        uint64_t mantissa = (uint64_t)ldexp(frexp(fabs(value), &exponent), 53);
+        int shift = exponent - 53 + FRACTION_BITS;
+
+        Fixed128 magnitude;
+        if (shift >= 64) magnitude = Fixed128(mantissa << (shift - 64), 0);
+        else if (shift > 0) magnitude = Fixed128(mantissa >> (64 - shift), mantissa << shift);
+        else if (shift == 0) magnitude = Fixed128(0, mantissa);
+        else if (shift > -64) magnitude = Fixed128(0, mantissa >> -shift);
+        return value < 0.0 ? negate(magnitude) : magnitude;
+    }
+
+    inline Fixed128 fromDoubleDouble(DoubleDouble value)
+    {
+        return add(fromDouble(value.hi), fromDouble(value.lo));
+    }
+
+    inline double toDouble(Fixed128 value)
+    {
+        Fixed128 magnitude = abs(value);
+        double result = ldexp((double)magnitude.hi, 64 - FRACTION_BITS) + ldexp((double)magnitude.lo, -FRACTION_BITS);
+        return value.negative() ? -result : result;
+    }
+}
+
+#endif
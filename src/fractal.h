@@ -0,0 +1,708 @@
+#ifndef FRACTAL_H
+#define FRACTAL_H
+
+#include <math.h>
+#include <vector>
+#include <memory>
+#include <glm/glm.hpp>
+#include "colour.h"
+#include "sampling.h"
+#include "utils.h"
+#include "precision.h"
+#include "doubleDouble.h"
+#include "quadDouble.h"
+#include "fixedPoint.h"
+
+#define LN_2 0.693147180559945309
+
+// CPU mirror of the fractal and colouring code in main.frag, keep both in sync
+namespace Fractal
+{
+    enum Type { MANDELBROT, JULIA, LERP };
+
+    inline void defaultView(Type type, glm::dvec2 &center, glm::dvec2 &dimensions)
+    {
+        switch (type)
+        {
+        case MANDELBROT:
+
+            dimensions = glm::dvec2(2.47, 2.24);
+            center = glm::dvec2(-0.765, 0.0);
+            
+        break;
+        case JULIA:
+
+            dimensions = glm::dvec2(3.0, 2.0);
+            center = glm::dvec2(0.0, 0.0);
+
+        break;
+        case LERP:
+
+            dimensions = glm::dvec2(3.0, 2.0);
+            center = glm::dvec2(0.0, 0.0);
+        
+        break;
+        }
+    }
+
+    inline std::vector<glm::vec3> defaultGradient()
+    {
+        return {
+            glm::vec3(0.0, 0.0, 0.0),
+            glm::vec3(1.0, 0.0, 0.0),
+            glm::vec3(1.0, 1.0, 0.0),
+            glm::vec3(1.0, 1.0, 1.0),
+        };
+    }
+
+    // Everything needed to render one view, independent of the GL renderer
+    struct Params
+    {
+        Type type = MANDELBROT;
+        int maxIterations = 50;
+        glm::ivec2 resolution = glm::ivec2(800, 800);
+        glm::dvec2 centerCoords = glm::dvec2(-0.765, 0.0);
+        glm::dvec2 dimensions = glm::dvec2(2.47, 2.24);
+        glm::dvec2 lerpAlpha = glm::dvec2(0.0);
+
+        // Low halves of `centerCoords` as double-doubles, for views deeper than a double can place
+        glm::dvec2 centerLow = glm::dvec2(0.0);
+
+        // Arithmetic of the escape-time kernels, AUTO picks one from the pixel spacing
+        Precision::Tier precision = Precision::AUTO;
+
+        // Orbit of the view centre the perturbation tier iterates against, filled in by prepare()
+        std::shared_ptr<const std::vector<glm::dvec2>> referenceOrbit;
+
+        bool doPixelSampling = true;
+        int samplingMethod = 0;
+        int samplesPerPixel = 1;
+
+        bool test = false;
+        bool doGammaCorrection = false;
+        bool smoothColouring = false;
+        float gradientDegree = 1.0f;
+        std::vector<glm::vec3> gradient = defaultGradient();
+
+        // Log-polar strip around `centerCoords` instead of a rectangle (batch renderer only, the GPU never renders strips)
+        // x is the angle and y the log radius going inwards from `mapRadius`, with square pixels so the map is conformal
+        bool exponentialMap = false;
+        double mapRadius = 0.0;
+    };
+
+    // * Colour calculation
+
+    inline glm::vec3 gradientValue(const Params &params, float a)
+    {
+        // `a` in [0.0, 1.0]
+        const std::vector<glm::vec3> &gradient = params.gradient;
+        int gradientSize = (int)gradient.size();
+
+        a = powf(a, params.gradientDegree);
+
+        // Out of range (or NaN) values would index outside the gradient
+        if (!(a >= 0.0f)) a = 0.0f;
+        if (a > 1.0f) a = 1.0f;
+
+        // Calculation breaks down on a == 1.0, so here's a base case
+        if (a == 1.0f) return gradient[gradientSize - 1];
+
+        // Calculate index of both values and alpha between both values
+        float offset = 1.0f / float(gradientSize - 1.0f);
+        int i = int(a / offset);
+        float a1 = (a - i*offset) / offset;
+
+        if (params.test)
+        {
+            // No HSL conversion
+            return glm::mix(gradient[i], gradient[i+1], a1);
+        }
+
+        // Linear interpolate both colours based on the alpha value, use HSL for better Hue mixing
+        Colour::RGB rgb1(gradient[i].r, gradient[i].g, gradient[i].b);
+        Colour::RGB rgb2(gradient[i+1].r, gradient[i+1].g, gradient[i+1].b);
+        glm::vec3 hslOut = glm::mix(Colour::toGlmVec3(Colour::RGBToHSL(rgb1)), Colour::toGlmVec3(Colour::RGBToHSL(rgb2)), a1);
+        Colour::HSL hsl(hslOut.x, hslOut.y, hslOut.z);
+
+        return Colour::toGlmVec3(Colour::HSLToRGB(hsl));
+    }
+
+    // Fractional escape count used by smooth colouring, from the first `z` past the bailout
+    inline float smoothIteration(glm::dvec2 z, int iteration)
+    {
+        float log_zn = logf(float(glm::dot(z, z))) / 2.0f;
+        float nu = logf(log_zn / LN_2) / LN_2;
+        return glm::max(float(iteration) + 1.0f - nu, 0.0f);
+    }
+
+    // Colour from escape data alone, so stored iteration data can be recoloured without iterating again
+    inline glm::vec3 iterationColour(const Params &params, int iteration, float smoothIter)
+    {
+        if (iteration < params.maxIterations)
+        {
+            float alpha = params.smoothColouring
+                ? sqrtf(params.maxIterations*smoothIter) / float(params.maxIterations)
+                : iteration / float(params.maxIterations);
+
+            return gradientValue(params, alpha);
+        }
+
+        return glm::vec3(0.0f);
+    }
+
+    inline glm::vec3 colMap(const Params &params, glm::dvec2 z, int iteration)
+    {
+        return iterationColour(params, iteration, params.smoothColouring ? smoothIteration(z, iteration) : 0.0f);
+    }
+
+    // * Fractal generation
+
+    inline int fractalRecurrence(glm::dvec2 &z, glm::dvec2 c, int maxIterations)
+    {
+        int iteration = 0;
+        while (glm::dot(z, z) <= 4.0 && iteration < maxIterations)
+        {
+            // z_n+1 = z_n*z_n + c
+            z = glm::dvec2(z.x*z.x - z.y*z.y, 2*z.x*z.y) + c;
+            iteration++;
+        }
+        return iteration;
+    }
+
+    inline glm::dvec2 planeCoords(const Params &params, glm::vec2 coord)
+    {
+        if (params.exponentialMap)
+        {
+            double step = 2.0*PI / params.resolution.x;
+            double radius = params.mapRadius*exp(-coord.y*step);
+            return params.centerCoords + radius*glm::dvec2(cos(coord.x*step), sin(coord.x*step));
+        }
+
+        // Normalize coords and translate to the desired x, y ranges
+        glm::dvec2 scale = glm::dvec2(params.resolution) / params.dimensions;
+        glm::dvec2 uv = glm::dvec2(coord) / scale;
+        uv += params.centerCoords - params.dimensions/2.0;
+
+        // Scale to fit aspect ratio
+        uv.y *= params.resolution.y / double(params.resolution.x);
+
+        return uv;
+    }
+
+    // Inverse of planeCoords for rectangular views
+    inline glm::dvec2 screenCoords(const Params &params, glm::dvec2 uv)
+    {
+        uv.y /= params.resolution.y / double(params.resolution.x);
+        uv -= params.centerCoords - params.dimensions/2.0;
+
+        return uv * glm::dvec2(params.resolution) / params.dimensions;
+    }
+
+    // Starting `z` and `c` for the plane point `uv`, and how fast each moves with `uv` (for distance estimates)
+    inline void startingPoint(const Params &params, glm::dvec2 uv, glm::dvec2 &z, glm::dvec2 &c, double &zWeight, double &cWeight)
+    {
+        switch (params.type)
+        {
+        case MANDELBROT:
+            c = uv;
+            z = glm::dvec2(0.0);
+            zWeight = 0.0; cWeight = 1.0;
+        break;
+        case JULIA:
+            z = uv;
+            c = glm::dvec2(-0.5251993);
+            zWeight = 1.0; cWeight = 0.0;
+        break;
+        case LERP:
+            c = glm::mix(uv, glm::dvec2(-0.5251993), params.lerpAlpha.x);
+            z = glm::mix(glm::dvec2(0.0), uv, params.lerpAlpha.y);
+            zWeight = params.lerpAlpha.y; cWeight = 1.0 - params.lerpAlpha.x;
+        break;
+        }
+    }
+
+    // * Precision tiers (see precision.h), mirrored in main.frag
+
+    // Distance between neighbouring pixels in the plane, the larger of the two axes
+    inline double pixelSpacing(const Params &params)
+    {
+        return glm::max(params.dimensions.x, params.dimensions.y) / params.resolution.x;
+    }
+
+    // The tier `params` render with, log-polar strips stay in double since their mapping is
+    inline Precision::Tier tier(const Params &params)
+    {
+        if (params.exponentialMap) return Precision::DOUBLE;
+        if (params.precision != Precision::AUTO) return params.precision;
+        return Precision::choose(pixelSpacing(params));
+    }
+
+    // Plane point of the view centre at double-double precision, with the same aspect scaling as planeCoords
+    inline void planeCenter(const Params &params, DoubleDouble &x, DoubleDouble &y)
+    {
+        x = DoubleDouble(params.centerCoords.x, params.centerLow.x);
+        y = DD::mul(DoubleDouble(params.centerCoords.y, params.centerLow.y), params.resolution.y / double(params.resolution.x));
+    }
+
+    // How far `coord` is from the view centre in the plane, small enough for a double at any depth
+    inline glm::dvec2 planeOffset(const Params &params, glm::vec2 coord)
+    {
+        glm::dvec2 scale = glm::dvec2(params.resolution) / params.dimensions;
+        glm::dvec2 offset = glm::dvec2(coord) / scale - params.dimensions/2.0;
+        offset.y *= params.resolution.y / double(params.resolution.x);
+        return offset;
+    }
+
+    // startingPoint as linear maps, z = uv*zWeight and c = uv*cWeight + cOffset
+    inline void startingWeights(const Params &params, double &zWeight, double &cWeight, glm::dvec2 &cOffset)
+    {
+        glm::dvec2 z, uv(0.0);
+        zWeight = 0.0; cWeight = 1.0; cOffset = glm::dvec2(0.0);
+        startingPoint(params, uv, z, cOffset, zWeight, cWeight);
+    }
+
+    inline int floatRecurrence(glm::vec2 &z, glm::vec2 c, int maxIterations)
+    {
+        int iteration = 0;
+        while (glm::dot(z, z) <= 4.0f && iteration < maxIterations)
+        {
+            z = glm::vec2(z.x*z.x - z.y*z.y, 2.0f*z.x*z.y) + c;
+            iteration++;
+        }
+        return iteration;
+    }
+
+    // `dz` (when set) carries the derivative dz/duv along for distance estimates, from the double part of z
+    inline int doubleDoubleRecurrence(DoubleDouble &zx, DoubleDouble &zy, DoubleDouble cx, DoubleDouble cy, int maxIterations, glm::dvec2 *dz = nullptr, double cWeight = 0.0)
+    {
+        int iteration = 0;
+        while (iteration < maxIterations)
+        {
+            DoubleDouble x2 = DD::sqr(zx), y2 = DD::sqr(zy);
+            if (x2.hi + y2.hi > 4.0) break;
+
+            if (dz) *dz = 2.0*glm::dvec2(zx.hi*dz->x - zy.hi*dz->y, zx.hi*dz->y + zy.hi*dz->x) + glm::dvec2(cWeight, 0.0);
+            DoubleDouble xy = DD::mul(zx, zy);
+            zx = DD::add(DD::sub(x2, y2), cx);
+            zy = DD::add(DD::twice(xy), cy);
+            iteration++;
+        }
+        return iteration;
+    }
+
+    inline int doubleDoubleIteration(const Params &params, glm::vec2 coord, glm::dvec2 &z, glm::dvec2 *dz = nullptr)
+    {
+        double zWeight, cWeight;
+        glm::dvec2 cOffset;
+        startingWeights(params, zWeight, cWeight, cOffset);
+
+        DoubleDouble ux, uy;
+        planeCenter(params, ux, uy);
+        glm::dvec2 offset = planeOffset(params, coord);
+        ux = DD::add(ux, offset.x);
+        uy = DD::add(uy, offset.y);
+
+        DoubleDouble zx = DD::mul(ux, zWeight), zy = DD::mul(uy, zWeight);
+        DoubleDouble cx = DD::add(DD::mul(ux, cWeight), cOffset.x), cy = DD::add(DD::mul(uy, cWeight), cOffset.y);
+        if (dz) *dz = glm::dvec2(zWeight, 0.0);
+
+        int iteration = doubleDoubleRecurrence(zx, zy, cx, cy, params.maxIterations, dz, cWeight);
+        z = glm::dvec2(zx.hi, zy.hi);
+        return iteration;
+    }
+
+    // doubleDoubleIteration for two points at once, one per SIMD lane (same results as one at a time)
+    // A lane that escapes keeps its z and count while the other carries on, neighbouring samples escape close together
+    inline void doubleDoubleIterations(const Params &params, const glm::vec2 coords[2], glm::dvec2 z[2], int iterations[2])
+    {
+        double zWeight, cWeight;
+        glm::dvec2 cOffset;
+        startingWeights(params, zWeight, cWeight, cOffset);
+
+        DoubleDouble ux, uy;
+        planeCenter(params, ux, uy);
+        glm::dvec2 offset[2] = { planeOffset(params, coords[0]), planeOffset(params, coords[1]) };
+        DoubleDouble2 vx(DD::add(ux, offset[0].x), DD::add(ux, offset[1].x));
+        DoubleDouble2 vy(DD::add(uy, offset[0].y), DD::add(uy, offset[1].y));
+
+        DoubleDouble2 zWeights(zWeight), cWeights(cWeight);
+        DoubleDouble2 zx = DD::mul(vx, zWeights), zy = DD::mul(vy, zWeights);
+        DoubleDouble2 cx = DD::add(DD::mul(vx, cWeights), DoubleDouble2(cOffset.x));
+        DoubleDouble2 cy = DD::add(DD::mul(vy, cWeights), DoubleDouble2(cOffset.y));
+
+        const Double2 BAILOUT = { 4.0, 4.0 };
+        iterations[0] = iterations[1] = 0;
+        for (int iteration = 0; iteration < params.maxIterations; iteration++)
+        {
+            DoubleDouble2 x2 = DD::sqr(zx), y2 = DD::sqr(zy);
+            Mask2 active = x2.hi + y2.hi <= BAILOUT;
+            if (!(active[0] | active[1])) break;
+
+            DoubleDouble2 xy = DD::mul(zx, zy);
+            zx = DD::select(active, DD::add(DD::sub(x2, y2), cx), zx);
+            zy = DD::select(active, DD::add(DD::twice(xy), cy), zy);
+            iterations[0] += active[0] != 0;
+            iterations[1] += active[1] != 0;
+        }
+
+        for (int i = 0; i < 2; i++) z[i] = glm::dvec2(zx.hi[i], zy.hi[i]);
+    }
+
+    // Same recurrence in quad-double
+    inline int quadDoubleRecurrence(QuadDouble &zx, QuadDouble &zy, const QuadDouble &cx, const QuadDouble &cy, int maxIterations, glm::dvec2 *dz = nullptr, double cWeight = 0.0)
+    {
+        int iteration = 0;
+        while (iteration < maxIterations)
+        {
+            QuadDouble x2 = QD::sqr(zx), y2 = QD::sqr(zy);
+            if (x2.x[0] + y2.x[0] > 4.0) break;
+
+            if (dz) *dz = 2.0*glm::dvec2(zx.x[0]*dz->x - zy.x[0]*dz->y, zx.x[0]*dz->y + zy.x[0]*dz->x) + glm::dvec2(cWeight, 0.0);
+            QuadDouble xy = QD::mul(zx, zy);
+            zx = QD::add(QD::sub(x2, y2), cx);
+            zy = QD::add(QD::twice(xy), cy);
+            iteration++;
+        }
+        return iteration;
+    }
+
+    inline int quadDoubleIteration(const Params &params, glm::vec2 coord, glm::dvec2 &z, glm::dvec2 *dz = nullptr)
+    {
+        double zWeight, cWeight;
+        glm::dvec2 cOffset;
+        startingWeights(params, zWeight, cWeight, cOffset);
+
+        DoubleDouble centerX, centerY;
+        planeCenter(params, centerX, centerY);
+        glm::dvec2 offset = planeOffset(params, coord);
+        QuadDouble ux = QD::add(QuadDouble(centerX), offset.x), uy = QD::add(QuadDouble(centerY), offset.y);
+
+        QuadDouble zx = QD::mul(ux, zWeight), zy = QD::mul(uy, zWeight);
+        QuadDouble cx = QD::add(QD::mul(ux, cWeight), cOffset.x), cy = QD::add(QD::mul(uy, cWeight), cOffset.y);
+        if (dz) *dz = glm::dvec2(zWeight, 0.0);
+
+        int iteration = quadDoubleRecurrence(zx, zy, cx, cy, params.maxIterations, dz, cWeight);
+        z = glm::dvec2(zx.x[0], zy.x[0]);
+        return iteration;
+    }
+
+    // Same recurrence in 128-bit fixed-point, the escape test is the only comparison and it's exact too
+    inline int fixedPointRecurrence(Fixed128 &zx, Fixed128 &zy, Fixed128 cx, Fixed128 cy, int maxIterations, glm::dvec2 *dz = nullptr, double cWeight = 0.0)
+    {
+        const Fixed128 BAILOUT = Fixed::fromInt(4);
+        int iteration = 0;
+        while (iteration < maxIterations)
+        {
+            Fixed128 x2 = Fixed::sqr(zx), y2 = Fixed::sqr(zy);
+            if (Fixed::greater(Fixed::add(x2, y2), BAILOUT)) break;
+
+            if (dz)
+            {
+                glm::dvec2 z(Fixed::toDouble(zx), Fixed::toDouble(zy));
+                *dz = 2.0*glm::dvec2(z.x*dz->x - z.y*dz->y, z.x*dz->y + z.y*dz->x) + glm::dvec2(cWeight, 0.0);
+            }
+            Fixed128 xy = Fixed::mul(zx, zy);
+            zx = Fixed::add(Fixed::sub(x2, y2), cx);
+            zy = Fixed::add(Fixed::twice(xy), cy);
+            iteration++;
+        }
+        return iteration;
+    }
+
+    inline int fixedPointIteration(const Params &params, glm::vec2 coord, glm::dvec2 &z, glm::dvec2 *dz = nullptr)
+    {
+        double zWeight, cWeight;
+        glm::dvec2 cOffset;
+        startingWeights(params, zWeight, cWeight, cOffset);
+
+        // Centre and offset converted separately, adding them as double-doubles would round at 2^-106
+        DoubleDouble centerX, centerY;
+        planeCenter(params, centerX, centerY);
+        glm::dvec2 offset = planeOffset(params, coord);
+
+        // Fixed-point only holds +-128. Starting inside +-4, z stays under 8 per component until it escapes, so its
+        // squares fit. Zoomed out views or far off Julia constants go to double-double rather than wrapping around
+        glm::dvec2 u = glm::abs(glm::dvec2(centerX.hi, centerY.hi) + offset);
+        glm::dvec2 start = u*fabs(zWeight), constant = u*fabs(cWeight) + glm::abs(cOffset);
+        bool fits = glm::max(glm::max(start.x, start.y), glm::max(constant.x, constant.y)) < 4.0
+            && glm::max(u.x, u.y) < 64.0 && glm::max(fabs(zWeight), fabs(cWeight)) < 64.0;
+        if (!fits) return doubleDoubleIteration(params, coord, z, dz);
+
+        Fixed128 ux = Fixed::add(Fixed::fromDoubleDouble(centerX), Fixed::fromDouble(offset.x));
+        Fixed128 uy = Fixed::add(Fixed::fromDoubleDouble(centerY), Fixed::fromDouble(offset.y));
+
+        Fixed128 zWeights = Fixed::fromDouble(zWeight), cWeights = Fixed::fromDouble(cWeight);
+        Fixed128 zx = Fixed::mul(ux, zWeights), zy = Fixed::mul(uy, zWeights);
+        Fixed128 cx = Fixed::add(Fixed::mul(ux, cWeights), Fixed::fromDouble(cOffset.x));
+        Fixed128 cy = Fixed::add(Fixed::mul(uy, cWeights), Fixed::fromDouble(cOffset.y));
+        if (dz) *dz = glm::dvec2(zWeight, 0.0);
+
+        int iteration = fixedPointRecurrence(zx, zy, cx, cy, params.maxIterations, dz, cWeight);
+        z = glm::dvec2(Fixed::toDouble(zx), Fixed::toDouble(zy));
+        return iteration;
+    }
+
+    // Orbit of the view centre, stored as doubles until it escapes (at least 2 points)
+    // Iterated in quad-double, so rounding along the orbit stays far below the pixel spacing past double-double's range
+    inline std::vector<glm::dvec2> referenceOrbit(const Params &params)
+    {
+        double zWeight, cWeight;
+        glm::dvec2 cOffset;
+        startingWeights(params, zWeight, cWeight, cOffset);
+
+        DoubleDouble centerX, centerY;
+        planeCenter(params, centerX, centerY);
+        QuadDouble ux(centerX), uy(centerY);
+        QuadDouble zx = QD::mul(ux, zWeight), zy = QD::mul(uy, zWeight);
+        QuadDouble cx = QD::add(QD::mul(ux, cWeight), cOffset.x), cy = QD::add(QD::mul(uy, cWeight), cOffset.y);
+
+        std::vector<glm::dvec2> orbit = { glm::dvec2(zx.x[0], zy.x[0]) };
+        while ((int)orbit.size() < 2 || ((int)orbit.size() <= params.maxIterations && glm::dot(orbit.back(), orbit.back()) <= 4.0))
+        {
+            QuadDouble xy = QD::mul(zx, zy);
+            zx = QD::add(QD::sub(QD::sqr(zx), QD::sqr(zy)), cx);
+            zy = QD::add(QD::twice(xy), cy);
+            orbit.push_back(glm::dvec2(zx.x[0], zy.x[0]));
+        }
+        return orbit;
+    }
+
+    // Iterates the difference to the reference orbit in plain doubles, rebasing onto the orbit's start whenever z gets
+    // closer to zero than to the reference or the reference runs out (Zhuoran's method, no glitches to detect)
+    inline int perturbationRecurrence(const std::vector<glm::dvec2> &reference, glm::dvec2 dz, glm::dvec2 dc, int maxIterations, glm::dvec2 &z, glm::dvec2 *derivative = nullptr, double cWeight = 0.0)
+    {
+        int m = 0, iteration = 0, last = (int)reference.size() - 1;
+        z = reference[0] + dz;
+        while (glm::dot(z, z) <= 4.0 && iteration < maxIterations)
+        {
+            if (glm::dot(z, z) < glm::dot(dz, dz) || m >= last)
+            {
+                dz = z - reference[0];
+                m = 0;
+            }
+            if (derivative) *derivative = 2.0*glm::dvec2(z.x*derivative->x - z.y*derivative->y, z.x*derivative->y + z.y*derivative->x) + glm::dvec2(cWeight, 0.0);
+
+            // dz_n+1 = (2*Z_n + dz_n)*dz_n + dc
+            glm::dvec2 a = 2.0*reference[m] + dz;
+            dz = glm::dvec2(a.x*dz.x - a.y*dz.y, a.x*dz.y + a.y*dz.x) + dc;
+            m++;
+            iteration++;
+            z = reference[m] + dz;
+        }
+        return iteration;
+    }
+
+    inline int perturbationIteration(const Params &params, glm::vec2 coord, glm::dvec2 &z, glm::dvec2 *derivative = nullptr)
+    {
+        double zWeight, cWeight;
+        glm::dvec2 cOffset;
+        startingWeights(params, zWeight, cWeight, cOffset);
+
+        glm::dvec2 offset = planeOffset(params, coord);
+        if (derivative) *derivative = glm::dvec2(zWeight, 0.0);
+        return perturbationRecurrence(*params.referenceOrbit, offset*zWeight, offset*cWeight, params.maxIterations, z, derivative, cWeight);
+    }
+
+    // Resolves the tier and builds the reference orbit when it's needed, call once per view before rendering it
+    // Unprepared params still render correctly, the perturbation tier then falls back to double-double
+    inline void prepare(Params &params)
+    {
+        params.precision = tier(params);
+        params.referenceOrbit.reset();
+        if (params.precision == Precision::PERTURBATION) params.referenceOrbit = std::make_shared<const std::vector<glm::dvec2>>(referenceOrbit(params));
+    }
+
+    inline Params prepared(Params params)
+    {
+        prepare(params);
+        return params;
+    }
+
+    inline int calculateIteration(const Params &params, glm::vec2 coord, glm::dvec2 &z)
+    {
+        Precision::Tier precision = tier(params);
+        if (precision == Precision::QUAD_DOUBLE) return quadDoubleIteration(params, coord, z);
+        if (precision == Precision::FIXED_POINT) return fixedPointIteration(params, coord, z);
+        if (precision == Precision::PERTURBATION && params.referenceOrbit) return perturbationIteration(params, coord, z);
+        if (precision >= Precision::DOUBLE_DOUBLE) return doubleDoubleIteration(params, coord, z);
+
+        glm::dvec2 c;
+        double zWeight, cWeight;
+        startingPoint(params, planeCoords(params, coord), z, c, zWeight, cWeight);
+
+        if (precision == Precision::FLOAT)
+        {
+            glm::vec2 zf(z);
+            int iteration = floatRecurrence(zf, glm::vec2(c), params.maxIterations);
+            z = glm::dvec2(zf);
+            return iteration;
+        }
+        return fractalRecurrence(z, c, params.maxIterations);
+    }
+
+    // Everything the colouring can use about one point's orbit
+    struct Escape
+    {
+        int iteration;
+        float smoothIteration;
+        float distance;     // Distance estimate to the set in plane units, 0 inside
+        glm::dvec2 z;
+    };
+
+    // Escape data is never coarser than double, the float tier only pays off for colours
+    inline Escape escape(const Params &params, glm::vec2 coord)
+    {
+        glm::dvec2 z, c, dz;
+        int iteration = 0;
+        Precision::Tier precision = tier(params);
+        if (precision == Precision::QUAD_DOUBLE) iteration = quadDoubleIteration(params, coord, z, &dz);
+        else if (precision == Precision::FIXED_POINT) iteration = fixedPointIteration(params, coord, z, &dz);
+        else if (precision == Precision::PERTURBATION && params.referenceOrbit) iteration = perturbationIteration(params, coord, z, &dz);
+        else if (precision >= Precision::DOUBLE_DOUBLE) iteration = doubleDoubleIteration(params, coord, z, &dz);
+        else
+        {
+            double zWeight, cWeight;
+            startingPoint(params, planeCoords(params, coord), z, c, zWeight, cWeight);
+
+            // Same recurrence as fractalRecurrence, carrying the derivative dz/duv along
+            dz = glm::dvec2(zWeight, 0.0);
+            while (glm::dot(z, z) <= 4.0 && iteration < params.maxIterations)
+            {
+                // dz_n+1 = 2*z_n*dz_n + dc
+                dz = 2.0*glm::dvec2(z.x*dz.x - z.y*dz.y, z.x*dz.y + z.y*dz.x) + glm::dvec2(cWeight, 0.0);
+                z = glm::dvec2(z.x*z.x - z.y*z.y, 2*z.x*z.y) + c;
+                iteration++;
+            }
+        }
+
+        Escape result = { iteration, 0.0f, 0.0f, z };
+        if (iteration < params.maxIterations)
+        {
+            double length = glm::length(z);
+            result.smoothIteration = smoothIteration(z, iteration);
+            result.distance = (float)(length*log(length) / glm::max(glm::length(dz), 1e-300));
+        }
+        return result;
+    }
+
+    inline glm::vec3 calculateColour(const Params &params, glm::vec2 coord)
+    {
+        glm::dvec2 z;
+        int iteration = calculateIteration(params, coord, z);
+
+        return colMap(params, z, iteration);
+    }
+
+    // Whether the SIMD kernel can take points two at a time (double-double, or perturbation without a reference orbit)
+    inline bool pairsPoints(const Params &params)
+    {
+        Precision::Tier precision = tier(params);
+        return precision == Precision::DOUBLE_DOUBLE || (precision == Precision::PERTURBATION && !params.referenceOrbit);
+    }
+
+    // calculateIteration for `count` points, two at a time through the SIMD kernel when the view allows it
+    inline void calculateIterations(const Params &params, const glm::vec2 *coords, int count, int *iterations)
+    {
+        glm::dvec2 z[2];
+        int i = 0;
+        if (pairsPoints(params))
+        {
+            for (; i + 1 < count; i += 2) doubleDoubleIterations(params, coords + i, z, iterations + i);
+        }
+        for (; i < count; i++) iterations[i] = calculateIteration(params, coords[i], z[0]);
+    }
+
+    // Adds up the colours of samples into per pixel sums, two at a time through the SIMD kernel on double-double views
+    // Samples pair up across pixels too, so a row of one sample pixels still fills both lanes. Each pixel's samples
+    // are added in the order they came, whichever lane they went through
+    struct ColourSum
+    {
+        const Params &params;
+        bool paired;
+        glm::vec3 *sums;
+        glm::vec2 pending;
+        int pendingPixel = -1;
+
+        ColourSum(const Params &params, glm::vec3 *sums)
+            : params(params), paired(pairsPoints(params)), sums(sums) {}
+
+        void add(int pixel, glm::vec2 coord)
+        {
+            if (!paired)
+            {
+                sums[pixel] += calculateColour(params, coord);
+                return;
+            }
+            if (pendingPixel < 0)
+            {
+                pending = coord;
+                pendingPixel = pixel;
+                return;
+            }
+
+            glm::vec2 coords[2] = { pending, coord };
+            glm::dvec2 z[2];
+            int iterations[2];
+            doubleDoubleIterations(params, coords, z, iterations);
+            sums[pendingPixel] += colMap(params, z[0], iterations[0]);
+            sums[pixel] += colMap(params, z[1], iterations[1]);
+            pendingPixel = -1;
+        }
+
+        // Adds the odd sample out, call before reading the sums
+        void flush()
+        {
+            if (pendingPixel >= 0) sums[pendingPixel] += calculateColour(params, pending);
+            pendingPixel = -1;
+        }
+    };
+
+    // * Pixel sampling, `x` and `y` are integer pixel indices (gl_FragCoord.xy - 0.5)
+
+    // Calls `f(coord)` for every sample of the pixel in this frame, returns how many there are
+    template <typename F>
+    inline float forEachSample(const Params &params, int x, int y, int frame, F f)
+    {
+        glm::vec2 fragCoord(x + 0.5f, y + 0.5f);
+        int spp = params.samplesPerPixel;
+
+        if (!params.doPixelSampling)
+        {
+            // No sampling, calculate colour at the pixel's center
+            f(fragCoord + 0.5f);
+            return 1.0f;
+        }
+
+        if (params.samplingMethod == 0)
+        {
+            // Random point, continuing the pixel's low discrepancy sequence
+            for (int i = 0; i < spp; i++)
+            {
+                glm::vec2 offset = Sampling::r2Sample(x, y, (uint32_t)(frame*spp + i), 0u) - 0.5f;
+                f(fragCoord + 0.5f + offset);
+            }
+            return (float)spp;
+        }
+
+        for (int i = 0; i < spp; i++)
+        {
+            for (int j = 0; j < spp; j++)
+            {
+                // Jittered grid follows one sequence per cell, plain grid uses the cell centres
+                glm::vec2 jitter = params.samplingMethod == 1
+                    ? Sampling::r2Sample(x, y, (uint32_t)frame, (uint32_t)(i*spp + j + 1))
+                    : glm::vec2(0.5f);
+                glm::vec2 offset = (glm::vec2((float)i, (float)j) + jitter) / (float)spp;
+                f(fragCoord + offset);
+            }
+        }
+        return (float)(spp*spp);
+    }
+
+    inline glm::vec3 gammaCorrect(glm::vec3 linear)
+    {
+        return glm::vec3(sqrtf(linear.x), sqrtf(linear.y), sqrtf(linear.z));
+    }
+}
+
+#endif
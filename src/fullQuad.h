@@ -12,9 +12,9 @@ public:
 
     FullQuad() {}
 
-    void init()
+    void init(ProgramCache *programCache = nullptr)
     {
-        shader = Shader("./src/shaders/quad.vert", "./src/shaders/quad.frag");
+        shader = Shader("./src/shaders/quad.vert", "./src/shaders/quad.frag", "", programCache);
 
         // Vertex data for a full-screen quad
         float quadVertices[] = {
@@ -0,0 +1,94 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include "paramFile.h"
+#include "cpuRenderer.h"
+
+// Helpers shared by the headless batch modes
+
+// Wall time spent in each named stage, stages may be entered more than once
+class StageTimer
+{
+public:
+
+    void stage(const char *name)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (current) total(current) += std::chrono::duration<double, std::milli>(now - start).count();
+        current = name;
+        start = now;
+    }
+
+    double report(FILE *out)
+    {
+        stage(nullptr);
+
+        double sum = 0.0;
+        for (auto &entry : stages)
+        {
+            fprintf(out, "%-10s %12.3f ms\n", entry.first, entry.second);
+            sum += entry.second;
+        }
+        fprintf(out, "%-10s %12.3f ms\n", "total", sum);
+
+        return sum;
+    }
+
+private:
+
+    const char *current = nullptr;
+    std::chrono::steady_clock::time_point start;
+    std::vector<std::pair<const char*, double>> stages;
+
+    double &total(const char *name)
+    {
+        for (auto &entry : stages)
+        {
+            if (strcmp(entry.first, name) == 0) return entry.second;
+        }
+        stages.push_back({ name, 0.0 });
+        return stages.back().second;
+    }
+};
+
+// Rows [y, y + height) of the image plus a halo of `halo` rows on each side for the denoiser
+inline Tile bandRegion(glm::ivec2 resolution, int y, int height, int halo)
+{
+    int bottom = std::max(0, y - halo);
+    int top = std::min(resolution.y, y + height + halo);
+    return { 0, bottom, resolution.x, top - bottom };
+}
+
+// Band height in rows, big enough to keep every thread busy
+inline int bandHeight(const ParamFile::Job &job, glm::ivec2 resolution, const CpuRenderer &renderer)
+{
+    if (job.bandRows > 0) return job.bandRows;
+
+    int tilesPerRow = (resolution.x + CpuRenderer::TILE_SIZE - 1) / CpuRenderer::TILE_SIZE;
+    int tileRows = (4*renderer.threadCount() + tilesPerRow - 1) / tilesPerRow;
+    return tileRows*CpuRenderer::TILE_SIZE;
+}
+
+inline bool endsWith(const std::string &text, const char *suffix)
+{
+    size_t length = strlen(suffix);
+    return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+}
+
+inline int jobThreadCount(const ParamFile::Job &job)
+{
+    return job.threads > 0 ? job.threads : std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+inline int pngThreadCount(const ParamFile::Job &job)
+{
+    return job.pngThreads > 0 ? job.pngThreads : jobThreadCount(job);
+}
+
+#endif
@@ -0,0 +1,369 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <condition_variable>
+#include "paramFile.h"
+#include "cpuRenderer.h"
+
+// Checkpoints of a banded image render, so a crashed or pre-empted job carries on instead of starting over
+//
+// Finished bands are appended as top-down RGB to `<checkpoint>.rows`, and `<checkpoint>` itself records how many of
+// them are safely on disk plus a snapshot of the band being rendered (its accumulation and the passes of each tile).
+// The state file is replaced atomically, and all the writing happens on a thread of its own so the workers only pause
+// for the snapshot copy. Perturbation reference orbits aren't saved, resuming recomputes them from the saved parameters
+// (Fractal::prepared), and that's deterministic so the resumed tiles match the ones rendered before
+class Checkpoint
+{
+public:
+
+    ~Checkpoint()
+    {
+        stop();
+    }
+
+    // Picks up an earlier checkpoint of the same job if there is one, `height` becomes the band height it used
+    bool open(const ParamFile::Job &job, int &height, CpuRenderer &renderer)
+    {
+        path = job.checkpoint;
+        rowsPath = path + ".rows";
+        width = job.params.resolution.x;
+        imageHeight = job.params.resolution.y;
+        bandHeight = height;
+        hash = jobHash(job);
+        interval = job.checkpointInterval;
+        target = &renderer;
+
+        if (load())
+        {
+            height = bandHeight;
+            printf("%s: resuming at band %d, %d row(s) already done\n", path.c_str(), bandsDone, rowsDone());
+        }
+        else
+        {
+            bandsDone = 0;
+            partialBand = -1;
+        }
+
+        // Drop whatever the rows file has past the last recorded band, it may be torn
+        rows = fopen(rowsPath.c_str(), bandsDone > 0 ? "r+b" : "w+b");
+        if (!rows || ftruncate(fileno(rows), (off_t)rowsDone()*width*3) != 0 || fseek(rows, 0, SEEK_END) != 0)
+        {
+            std::cerr << "Error: could not open `" << rowsPath << "` for writing" << std::endl;
+            if (rows) fclose(rows);
+            rows = nullptr;
+            return false;
+        }
+
+        signal(SIGTERM, onSignal);
+        signal(SIGINT, onSignal);
+        saver = std::thread(&Checkpoint::saverLoop, this);
+        return true;
+    }
+
+    // The first band still to render, everything above it is in the rows file
+    int firstBand() const { return bandsDone; }
+
+    // Hands the rows of the bands already done to `write(rgb, rows)`, top-down like the bands themselves
+    template <typename F>
+    bool replayRows(F write)
+    {
+        std::vector<uint8_t> rgb((size_t)bandHeight*width*3);
+        FILE *file = fopen(rowsPath.c_str(), "rb");
+        bool ok = file != nullptr;
+        for (int row = 0; ok && row < rowsDone(); row += bandHeight)
+        {
+            int count = std::min(bandHeight, rowsDone() - row);
+            ok = fread(rgb.data(), (size_t)width*3, count, file) == (size_t)count && write(rgb.data(), count);
+        }
+        if (file) fclose(file);
+
+        if (!ok) std::cerr << "Error: could not read back `" << rowsPath << "`" << std::endl;
+        return ok;
+    }
+
+    // Starts `band` on the renderer, from the saved snapshot when there is one for it
+    void startBand(const Fractal::Params &params, int passes, int band, const Tile &region)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        bool resumable = band == partialBand
+            && memcmp(&partial.region, &region, sizeof(Tile)) == 0
+            && partial.accumulation.size() == (size_t)region.width*region.height;
+        if (resumable) target->resume(params, passes, partial);
+        else target->start(params, passes, region);
+
+        partialBand = -1;
+        partial = RenderProgress();
+        currentBand = band;
+    }
+
+    // Call once the band's passes are done, before its buffers are taken off the renderer
+    void endBand()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        currentBand = -1;
+    }
+
+    // Queues a finished band's top-down RGB rows for the rows file
+    void finishBand(const uint8_t *rgb, int count)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.emplace_back(rgb, rgb + (size_t)count*width*3);
+        wake.notify_all();
+    }
+
+    // The render made it, the checkpoint isn't needed any more
+    void remove()
+    {
+        stop();
+        ::remove(path.c_str());
+        ::remove(rowsPath.c_str());
+    }
+
+    int savesWritten() const { return saves; }
+
+private:
+
+    struct StateHeader
+    {
+        char magic[8];
+        uint32_t version;
+        int32_t width, height, bandHeight;
+        int32_t bandsDone;
+        int32_t partialBand;    // -1 when there is no snapshot
+        int32_t tileCount;
+        Tile region;
+        uint64_t jobHash;
+    };
+
+    static constexpr uint32_t VERSION = 1;
+
+    std::string path, rowsPath;
+    int width = 0, imageHeight = 0, bandHeight = 0;
+    uint64_t hash = 0;
+    double interval = 60.0;
+    CpuRenderer *target = nullptr;
+    FILE *rows = nullptr;
+    std::thread saver;
+    int saves = 0;
+
+    // Guarded by `mutex`
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    int bandsDone = 0;
+    int currentBand = -1;
+    int partialBand = -1;
+    RenderProgress partial;
+    std::deque<std::vector<uint8_t>> pending;
+
+    static inline volatile sig_atomic_t interruptSignal = 0;
+
+    static void onSignal(int signal)
+    {
+        interruptSignal = signal;
+    }
+
+    int rowsDone() const
+    {
+        return std::min(imageHeight, bandsDone*bandHeight);
+    }
+
+    // Everything that changes the output, anything else (threads, compression...) may differ between runs
+    static uint64_t jobHash(const ParamFile::Job &job)
+    {
+        const Fractal::Params &params = job.params;
+        uint64_t h = hashValue(params.type);
+        h = hashValue(params.maxIterations, h);
+        h = hashValue(params.resolution, h);
+        h = hashValue(params.centerCoords, h);
+        h = hashValue(params.centerLow, h);
+        h = hashValue(params.precision, h);
+        h = hashValue(params.dimensions, h);
+        h = hashValue(params.lerpAlpha, h);
+        h = hashValue(params.doPixelSampling, h);
+        h = hashValue(params.samplingMethod, h);
+        h = hashValue(params.samplesPerPixel, h);
+        h = hashValue(params.test, h);
+        h = hashValue(params.doGammaCorrection, h);
+        h = hashValue(params.smoothColouring, h);
+        h = hashValue(params.gradientDegree, h);
+        for (const glm::vec3 &colour : params.gradient)
+        {
+            h = hashValue(colour.r, hashValue(colour.g, hashValue(colour.b, h)));
+        }
+        h = hashValue(job.passes, h);
+        h = hashValue(job.denoise.enabled, h);
+        h = hashValue(job.denoise.radius, h);
+        h = hashValue(job.denoise.colourSigma, h);
+        h = hashValue(job.denoise.iterationSigma, h);
+        return hashValue(job.denoise.fadeFrames, h);
+    }
+
+    bool load()
+    {
+        FILE *file = fopen(path.c_str(), "rb");
+        if (!file) return false;
+
+        StateHeader header = {};
+        bool ok = fread(&header, sizeof(header), 1, file) == 1
+            && memcmp(header.magic, "FRACCKPT", 8) == 0 && header.version == VERSION
+            && header.jobHash == hash && header.width == width && header.height == imageHeight
+            && header.bandHeight > 0 && header.bandsDone >= 0;
+
+        // The rows file has to hold every band the state says is done
+        FILE *rowsFile = ok ? fopen(rowsPath.c_str(), "rb") : nullptr;
+        if (ok)
+        {
+            bandHeight = header.bandHeight;
+            bandsDone = header.bandsDone;
+            ok = rowsFile && fseeko(rowsFile, 0, SEEK_END) == 0 && ftello(rowsFile) >= (off_t)rowsDone()*width*3;
+        }
+        if (rowsFile) fclose(rowsFile);
+
+        partialBand = -1;
+        if (ok && header.partialBand >= 0 && header.tileCount >= 0 && header.region.width*(int64_t)header.region.height <= (int64_t)width*imageHeight)
+        {
+            size_t pixels = (size_t)header.region.width*header.region.height;
+            partial.region = header.region;
+            partial.tilePasses.resize(header.tileCount);
+            partial.accumulation.resize(pixels);
+            partial.iterations.resize(pixels);
+
+            bool read = true;
+            for (auto &tile : partial.tilePasses)
+            {
+                int32_t values[5];
+                read = read && fread(values, sizeof(values), 1, file) == 1;
+                tile = { { values[0], values[1], values[2], values[3] }, values[4] };
+            }
+            read = read && fread(partial.accumulation.data(), sizeof(glm::vec4), pixels, file) == pixels
+                && fread(partial.iterations.data(), sizeof(float), pixels, file) == pixels;
+            if (read) partialBand = header.partialBand;
+        }
+        fclose(file);
+
+        if (header.version == VERSION && header.jobHash != hash) printf("%s: belongs to a different job, starting over\n", path.c_str());
+        return ok;
+    }
+
+    // Written under a temporary name and renamed over the old one, so there's always one whole checkpoint
+    bool save(int savedBands, int band, const RenderProgress &progress)
+    {
+        StateHeader header = {};
+        memcpy(header.magic, "FRACCKPT", 8);
+        header.version = VERSION;
+        header.width = width;
+        header.height = imageHeight;
+        header.bandHeight = bandHeight;
+        header.bandsDone = savedBands;
+        header.partialBand = band;
+        header.tileCount = band >= 0 ? (int32_t)progress.tilePasses.size() : 0;
+        header.region = band >= 0 ? progress.region : Tile { 0, 0, 0, 0 };
+        header.jobHash = hash;
+
+        std::string temporaryPath = path + ".part";
+        FILE *file = fopen(temporaryPath.c_str(), "wb");
+        if (!file) return false;
+
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+        if (band >= 0)
+        {
+            for (const auto &tile : progress.tilePasses)
+            {
+                int32_t values[5] = { tile.first.x, tile.first.y, tile.first.width, tile.first.height, tile.second };
+                ok = ok && fwrite(values, sizeof(values), 1, file) == 1;
+            }
+            ok = ok && fwrite(progress.accumulation.data(), sizeof(glm::vec4), progress.accumulation.size(), file) == progress.accumulation.size()
+                && fwrite(progress.iterations.data(), sizeof(float), progress.iterations.size(), file) == progress.iterations.size();
+        }
+        ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+        ok &= fclose(file) == 0;
+        ok = ok && rename(temporaryPath.c_str(), path.c_str()) == 0;
+
+        if (!ok) std::cerr << "Error: could not write checkpoint `" << path << "`" << std::endl;
+        return ok;
+    }
+
+    void saverLoop()
+    {
+        auto nextSave = std::chrono::steady_clock::now() + std::chrono::duration<double>(interval);
+        RenderProgress progress;
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (true)
+        {
+            // Short waits so a signal gets noticed quickly
+            wake.wait_for(lock, std::chrono::milliseconds(200), [this] { return stopping || !pending.empty(); });
+
+            // Finished bands first, synced before any state file counts them
+            while (!pending.empty())
+            {
+                std::vector<uint8_t> band = std::move(pending.front());
+                pending.pop_front();
+                lock.unlock();
+                bool ok = fwrite(band.data(), 1, band.size(), rows) == band.size() && fflush(rows) == 0 && fsync(fileno(rows)) == 0;
+                lock.lock();
+
+                if (!ok)
+                {
+                    std::cerr << "Error: could not append to `" << rowsPath << "`, checkpoints stop here" << std::endl;
+                    return;
+                }
+                bandsDone++;
+            }
+
+            if (stopping) return;
+            int signal = interruptSignal;
+            if (!signal && std::chrono::steady_clock::now() < nextSave) continue;
+
+            // Snapshot under the lock so it matches `currentBand`, then write without holding anything
+            int band = currentBand == bandsDone ? currentBand : -1;
+            if (band >= 0) target->snapshot(progress);
+            int savedBands = bandsDone;
+            lock.unlock();
+
+            if (save(savedBands, band, progress)) saves++;
+            nextSave = std::chrono::steady_clock::now() + std::chrono::duration<double>(interval);
+            if (signal)
+            {
+                fprintf(stderr, "%s: saved, stopping on signal %d\n", path.c_str(), signal);
+                fflush(stdout);
+                _exit(128 + signal);
+            }
+
+            lock.lock();
+        }
+    }
+
+    void stop()
+    {
+        if (!saver.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        saver.join();
+
+        fclose(rows);
+        rows = nullptr;
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+    }
+};
+
+#endif
@@ -0,0 +1,519 @@
+#ifndef FARM_H
+#define FARM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <memory>
+#include <sstream>
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "paramFile.h"
+#include "cpuRenderer.h"
+#include "image.h"
+#include "iterationFile.h"
+#include "batch.h"
+
+// Render farm, a coordinator splits one image into bands of rows and hands them out to worker processes over TCP
+// Local workers are spawned by the coordinator, workers on other machines join with `headless --worker host:port [key=value ...]`,
+// the job they get leaves out `threads` so each keeps its own (or the one given after the address)
+// Each message is a { type, payload size } pair of little-endian 64-bit words followed by the payload, iteration file
+// bands easily pass 4 GB. Sizes past what the message type can hold drop the connection before anything is allocated
+// POSIX sockets only, headless leaves the farm out on Windows
+// There's no authentication, so `farm_bind` only leaves loopback for networks where every machine is trusted
+namespace Farm
+{
+    enum MessageType : uint32_t
+    {
+        JOB = 1,        // Parameter file text
+        BAND = 2,       // int32 y, rows
+        RESULT = 3,     // int32 y, rows, then the band's top-down RGB or iteration planes
+        DONE = 4,
+    };
+
+    struct Message
+    {
+        uint32_t type;
+        std::vector<uint8_t> payload;
+    };
+
+    // Longest a connection may go quiet in the middle of a message, in seconds
+    constexpr int RECEIVE_TIMEOUT = 30;
+
+    // Parameter files are a few kB, a job announcing more than this is from a confused or hostile peer
+    constexpr uint64_t MAX_JOB_BYTES = 1 << 20;
+
+    inline bool sendAll(int fd, const void *data, size_t size)
+    {
+        const uint8_t *bytes = (const uint8_t*)data;
+        while (size > 0)
+        {
+            ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent <= 0) return false;
+            bytes += sent;
+            size -= sent;
+        }
+        return true;
+    }
+
+    inline bool receiveAll(int fd, void *data, size_t size)
+    {
+        uint8_t *bytes = (uint8_t*)data;
+        while (size > 0)
+        {
+            ssize_t received = recv(fd, bytes, size, 0);
+            if (received < 0 && errno == EINTR) continue;
+            if (received <= 0) return false;
+            bytes += received;
+            size -= received;
+        }
+        return true;
+    }
+
+    inline bool sendMessage(int fd, uint32_t type, const void *payload = nullptr, size_t size = 0)
+    {
+        uint64_t header[2] = { type, size };
+        return sendAll(fd, header, sizeof(header)) && (size == 0 || sendAll(fd, payload, size));
+    }
+
+    // Fails without reading the payload when the peer announces more than `maxSize` bytes, the connection is dropped
+    inline bool receiveMessage(int fd, Message &message, uint64_t maxSize)
+    {
+        uint64_t header[2];
+        if (!receiveAll(fd, header, sizeof(header))) return false;
+        if (header[1] > maxSize)
+        {
+            std::cerr << "Error: a " << header[1] << " byte message is over the " << maxSize << " bytes expected" << std::endl;
+            return false;
+        }
+
+        message.type = (uint32_t)header[0];
+        message.payload.resize(header[1]);
+        return header[1] == 0 || receiveAll(fd, message.payload.data(), header[1]);
+    }
+
+    // Iteration file outputs are farmed out as escape data, everything else as resolved colours
+    inline bool iterationOutput(const ParamFile::Job &job)
+    {
+        return endsWith(job.output, ".iter");
+    }
+
+    // Size of one row of results, the planes of iteration outputs go z first so every plane stays aligned
+    inline size_t rowBytes(const ParamFile::Job &job)
+    {
+        size_t width = job.params.resolution.x;
+        if (!iterationOutput(job)) return width*3;
+
+        return width*(sizeof(int32_t)
+            + (job.channels & IterationFile::SMOOTH ? sizeof(float) : 0)
+            + (job.channels & IterationFile::DISTANCE ? sizeof(float) : 0)
+            + (job.channels & IterationFile::FINAL_Z ? sizeof(glm::dvec2) : 0));
+    }
+
+    // Pointers to each plane of a band's results, null for missing channels
+    struct Planes
+    {
+        glm::dvec2 *z;
+        int32_t *iterations;
+        float *smooth, *distance;
+    };
+
+    inline Planes bandPlanes(const ParamFile::Job &job, uint8_t *data, int rows)
+    {
+        size_t pixels = (size_t)rows*job.params.resolution.x;
+        Planes planes = {};
+        if (job.channels & IterationFile::FINAL_Z) { planes.z = (glm::dvec2*)data; data += pixels*sizeof(glm::dvec2); }
+        planes.iterations = (int32_t*)data; data += pixels*sizeof(int32_t);
+        if (job.channels & IterationFile::SMOOTH) { planes.smooth = (float*)data; data += pixels*sizeof(float); }
+        if (job.channels & IterationFile::DISTANCE) { planes.distance = (float*)data; }
+        return planes;
+    }
+
+    // * Worker
+
+    // Renders rows [y, y + rows) of the job into `result`, after its { y, rows } header
+    inline void renderBand(const ParamFile::Job &job, CpuRenderer &renderer, int y, int rows, std::vector<uint8_t> &result)
+    {
+        const size_t HEADER = 2*sizeof(int32_t);
+        result.resize(HEADER + rows*rowBytes(job));
+        int32_t band[2] = { y, rows };
+        memcpy(result.data(), band, HEADER);
+
+        if (iterationOutput(job))
+        {
+            Planes planes = bandPlanes(job, result.data() + HEADER, rows);
+            IterationFile::renderRows(job.params, y, y + rows, renderer.threadCount(), planes.iterations, planes.smooth, planes.distance, planes.z);
+            return;
+        }
+
+        // Render with a halo for the denoiser, then resolve only the band itself
+        glm::ivec2 resolution = job.params.resolution;
+        renderer.start(job.params, job.passes, bandRegion(resolution, y, rows, job.denoise.enabled ? job.denoise.radius : 0));
+        renderer.wait();
+        Tile region = renderer.currentRegion();
+
+        std::vector<glm::vec4> accumulation;
+        std::vector<float> iterations;
+        std::vector<uint8_t> rgb;
+        renderer.takeResult(accumulation, iterations);
+        Image::resolve(accumulation, iterations, glm::ivec2(region.width, region.height), y - region.y, y - region.y + rows, job.passes, job.denoise, rgb);
+        memcpy(result.data() + HEADER, rgb.data(), rgb.size());
+    }
+
+    inline int connectTo(const std::string &address)
+    {
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos)
+        {
+            std::cerr << "Error: expected host:port, got `" << address << "`" << std::endl;
+            return -1;
+        }
+        std::string host = address.substr(0, colon), port = address.substr(colon + 1);
+
+        addrinfo hints = {}, *addresses;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0)
+        {
+            std::cerr << "Error: could not resolve `" << address << "`" << std::endl;
+            return -1;
+        }
+
+        int fd = -1;
+        for (addrinfo *a = addresses; a && fd < 0; a = a->ai_next)
+        {
+            fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0)
+            {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(addresses);
+
+        if (fd < 0) std::cerr << "Error: could not connect to `" << address << "`" << std::endl;
+        return fd;
+    }
+
+    // Job text without the lines for `key`, for settings that belong to each machine rather than the job
+    inline std::string withoutKey(const std::string &jobText, const std::string &key)
+    {
+        std::istringstream text(jobText);
+        std::string line, kept;
+        while (std::getline(text, line))
+        {
+            if (ParamFile::keyOf(line) != key) kept += line + "\n";
+        }
+        return kept;
+    }
+
+    // Renders whatever bands the coordinator at `address` hands out until it says it's done,
+    // `overrides` are `key=value` lines applied on top of the coordinator's job
+    inline int runWorker(const std::string &address, const std::vector<std::string> &overrides)
+    {
+        int fd = connectTo(address);
+        if (fd < 0) return 1;
+
+        ParamFile::Job job;
+        std::unique_ptr<CpuRenderer> renderer;
+        std::vector<uint8_t> result;
+        Message message;
+
+        bool ok = true;
+        while (receiveMessage(fd, message, MAX_JOB_BYTES) && message.type != DONE)
+        {
+            if (message.type == JOB)
+            {
+                std::istringstream text(std::string(message.payload.begin(), message.payload.end()));
+                std::string line;
+                while (std::getline(text, line))
+                {
+                    if (!ParamFile::parseLine(line, job)) return 1;
+                }
+                for (const std::string &override : overrides)
+                {
+                    if (!ParamFile::parseLine(override, job)) return 1;
+                }
+                if (!ParamFile::finish(job)) return 1;
+                renderer.reset(new CpuRenderer(job.threads));
+            }
+            else if (message.type == BAND && renderer && message.payload.size() == 2*sizeof(int32_t))
+            {
+                int32_t band[2];
+                memcpy(band, message.payload.data(), sizeof(band));
+                renderBand(job, *renderer, band[0], band[1], result);
+                if (!sendMessage(fd, RESULT, result.data(), result.size())) break;
+            }
+            else
+            {
+                std::cerr << "Error: unexpected message from the coordinator" << std::endl;
+                ok = false;
+                break;
+            }
+        }
+
+        close(fd);
+        return ok ? 0 : 1;
+    }
+
+    // * Coordinator
+
+    // Listens on `port` (any free one when 0) at the IPv4 address `host`
+    inline int listenOn(int &port, const std::string &host)
+    {
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons((uint16_t)port);
+        if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1)
+        {
+            std::cerr << "Error: `" << host << "` is not an IPv4 address to listen on" << std::endl;
+            return -1;
+        }
+
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        int yes = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+        socklen_t length = sizeof(address);
+        if (fd < 0 || bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 64) != 0 || getsockname(fd, (sockaddr*)&address, &length) != 0)
+        {
+            std::cerr << "Error: could not listen on " << host << ":" << port << std::endl;
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+
+        port = ntohs(address.sin_port);
+        return fd;
+    }
+
+    // Local workers share this machine, so they take the coordinator's `threads` when it's set
+    inline pid_t spawnWorker(const char *executable, int port, int threads)
+    {
+        std::string address = "127.0.0.1:" + std::to_string(port), threadsLine = "threads=" + std::to_string(threads);
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            if (threads > 0) execl(executable, executable, "--worker", address.c_str(), threadsLine.c_str(), (char*)nullptr);
+            else execl(executable, executable, "--worker", address.c_str(), (char*)nullptr);
+            _exit(127);
+        }
+        return pid;
+    }
+
+    // Renders the job on workers, writing the image top-down as bands come back or filling the iteration file in place
+    // Bands of workers that disappear or take longer than `farm_timeout` are handed to the next free worker,
+    // and dead local workers are replaced
+    inline int runCoordinator(const ParamFile::Job &job, const std::string &jobText, const char *executable, StageTimer &timer)
+    {
+        if (job.frames > 0)
+        {
+            std::cerr << "Error: the farm renders single images and iteration files, not videos" << std::endl;
+            return 1;
+        }
+
+        // Only local workers without a port, so there's nothing to listen for beyond loopback
+        int port = job.farmPort;
+        int listener = listenOn(port, job.farmPort == 0 ? "127.0.0.1" : job.farmBind);
+        if (listener < 0) return 1;
+        std::string forwardedJob = withoutKey(jobText, "threads");
+        fprintf(stderr, "farm: listening on port %d, join with `--worker <host>:%d`\n", port, port);
+
+        // Local workers, run this same binary
+        if (access("/proc/self/exe", X_OK) == 0) executable = "/proc/self/exe";
+        std::set<pid_t> children;
+        for (int i = 0; i < job.farmWorkers; i++) children.insert(spawnWorker(executable, port, job.threads));
+        int respawnsLeft = job.farmWorkers;
+
+        // Output
+        glm::ivec2 resolution = job.params.resolution;
+        bool iterations = iterationOutput(job);
+        IterationFile::File file;
+        Image::StreamWriter writer;
+        if (iterations ? !file.create(job.output, job.params, job.channels) : !writer.open(job.output, resolution, job.compression, pngThreadCount(job))) return 1;
+
+        // Bands of whole tile rows top-down, small enough to balance the load between workers
+        int height = job.bandRows > 0 ? job.bandRows : 4*CpuRenderer::TILE_SIZE;
+        int bandCount = (resolution.y + height - 1) / height;
+        auto bandY = [&](int band) { return std::max(0, resolution.y - (band + 1)*height); };
+        auto bandRows = [&](int band) { return resolution.y - band*height - bandY(band); };
+        uint64_t resultBytes = 2*sizeof(int32_t) + (uint64_t)height*rowBytes(job);
+
+        std::deque<int> queue;
+        for (int band = 0; band < bandCount; band++) queue.push_back(band);
+
+        using Clock = std::chrono::steady_clock;
+        struct Worker
+        {
+            int fd;
+            int band;
+            Clock::time_point assigned;
+        };
+        std::vector<Worker> workers;
+        std::map<int, std::vector<uint8_t>> finished;
+        int nextToWrite = 0, bandsDone = 0, workersSeen = 0, bandsLost = 0;
+
+        auto assign = [&](Worker &worker)
+        {
+            if (worker.band >= 0 || queue.empty()) return true;
+            worker.band = queue.front();
+            worker.assigned = Clock::now();
+            queue.pop_front();
+            int32_t band[2] = { bandY(worker.band), bandRows(worker.band) };
+            return sendMessage(worker.fd, BAND, band, sizeof(band));
+        };
+        auto drop = [&](size_t i, const char *why)
+        {
+            if (workers[i].band >= 0)
+            {
+                queue.push_front(workers[i].band);
+                bandsLost++;
+                fprintf(stderr, "farm: %s, band %d goes back in the queue\n", why, workers[i].band);
+            }
+            close(workers[i].fd);
+            workers.erase(workers.begin() + i);
+        };
+
+        timer.stage("render");
+        while (bandsDone < bandCount)
+        {
+            // Replace local workers that died while there's still work
+            int status;
+            pid_t pid;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+            {
+                children.erase(pid);
+                if (respawnsLeft-- > 0) children.insert(spawnWorker(executable, port, job.threads));
+            }
+            if (workers.empty() && children.empty() && job.farmPort == 0)
+            {
+                std::cerr << "Error: every worker died" << std::endl;
+                return 1;
+            }
+
+            // Workers stuck on a band lose it, in case they hung or their machine went away without closing the connection
+            for (size_t i = 0; i < workers.size(); i++)
+            {
+                double seconds = std::chrono::duration<double>(Clock::now() - workers[i].assigned).count();
+                if (job.farmTimeout > 0.0 && workers[i].band >= 0 && seconds > job.farmTimeout) drop(i--, "a worker timed out");
+            }
+
+            // Idle workers pick up bands lost by others
+            for (size_t i = 0; i < workers.size(); i++)
+            {
+                if (!assign(workers[i])) drop(i--, "lost a worker");
+            }
+
+            std::vector<pollfd> fds = { { listener, POLLIN, 0 } };
+            for (Worker &worker : workers) fds.push_back({ worker.fd, POLLIN, 0 });
+            if (poll(fds.data(), fds.size(), 500) <= 0) continue;
+
+            for (size_t i = fds.size() - 1; i >= 1; i--)
+            {
+                if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+                Worker &worker = workers[i - 1];
+                Message message;
+                int32_t band[2];
+                bool ok = receiveMessage(worker.fd, message, resultBytes) && message.type == RESULT && message.payload.size() >= sizeof(band);
+                if (ok) memcpy(band, message.payload.data(), sizeof(band));
+                ok = ok && worker.band >= 0 && band[0] == bandY(worker.band) && band[1] == bandRows(worker.band)
+                    && message.payload.size() == sizeof(band) + band[1]*rowBytes(job);
+                if (!ok)
+                {
+                    drop(i - 1, "lost a worker");
+                    continue;
+                }
+
+                if (iterations)
+                {
+                    // Straight into the mapped planes
+                    size_t offset = (size_t)band[0]*resolution.x, pixels = (size_t)band[1]*resolution.x;
+                    Planes planes = bandPlanes(job, message.payload.data() + sizeof(band), band[1]);
+                    memcpy(file.iterations() + offset, planes.iterations, pixels*sizeof(int32_t));
+                    if (planes.smooth) memcpy(file.smoothIterations() + offset, planes.smooth, pixels*sizeof(float));
+                    if (planes.distance) memcpy(file.distances() + offset, planes.distance, pixels*sizeof(float));
+                    if (planes.z) memcpy(file.finalZ() + offset, planes.z, pixels*sizeof(glm::dvec2));
+                }
+                else
+                {
+                    finished[worker.band] = std::move(message.payload);
+                }
+                worker.band = -1;
+                bandsDone++;
+            }
+
+            if (fds[0].revents & POLLIN)
+            {
+                // Results are only read once they start arriving, the timeout keeps one that stops halfway from blocking the rest
+                int fd = accept(listener, nullptr, nullptr);
+                timeval timeout = { RECEIVE_TIMEOUT, 0 };
+                if (fd >= 0) setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                if (fd >= 0 && sendMessage(fd, JOB, forwardedJob.data(), forwardedJob.size()))
+                {
+                    workers.push_back({ fd, -1, Clock::now() });
+                    workersSeen++;
+                }
+                else if (fd >= 0) close(fd);
+            }
+
+            // Images are written top-down, so bands wait until everything above them is in
+            timer.stage("write");
+            for (auto next = finished.find(nextToWrite); next != finished.end(); next = finished.find(nextToWrite))
+            {
+                if (!writer.writeRows(next->second.data() + 2*sizeof(int32_t), bandRows(nextToWrite))) return 1;
+                finished.erase(next);
+                nextToWrite++;
+            }
+            timer.stage("render");
+        }
+
+        // Let everyone go
+        for (Worker &worker : workers)
+        {
+            sendMessage(worker.fd, DONE);
+            close(worker.fd);
+        }
+        close(listener);
+
+        // Local workers that timed out may still be busy with a band nobody needs now
+        for (int waited = 0; !children.empty() && waited < 50; waited++)
+        {
+            pid_t pid;
+            while ((pid = waitpid(-1, nullptr, WNOHANG)) > 0) children.erase(pid);
+            if (!children.empty()) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        for (pid_t child : children)
+        {
+            kill(child, SIGTERM);
+            waitpid(child, nullptr, 0);
+        }
+
+        timer.stage("write");
+        if (iterations) file.close();
+        else if (!writer.close()) return 1;
+
+        printf("%s: %dx%d, %d band(s) of %d rows over %d worker connection(s), %d band(s) re-dispatched\n", job.output.c_str(), resolution.x, resolution.y, bandCount, height, workersSeen, bandsLost);
+        timer.report(stdout);
+
+        return 0;
+    }
+}
+
+#endif
@@ -0,0 +1,478 @@
+// Headless batch renderer, renders a parameter file with the CPU engine (no window system needed)
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <iostream>
+#include "paramFile.h"
+#include "cpuRenderer.h"
+#include "image.h"
+#include "expMap.h"
+#include "iterationFile.h"
+#include "batch.h"
+#include "checkpoint.h"
+#ifndef _WIN32
+#include "farm.h"
+#include "tileServer.h"
+#endif
+
+// Renders `params` in bands of whole tile rows so memory stays bounded regardless of the image size
+// Bands go top-down since that's the order image files store rows in, each one is resolved and handed to
+// `write(rgb, y, rows)` (top-down RGB, `y` is the band's bottom row) while the next one renders
+// With a `checkpoint`, rendering starts at its first unfinished band and finished bands are handed to it as well
+// Only rows [bottom, top) are rendered when given, `top` defaults to the image height
+template <typename F>
+bool renderBands(const ParamFile::Job &job, const Fractal::Params &params, CpuRenderer &renderer, StageTimer &timer, int height, F write, Checkpoint *checkpoint = nullptr, int bottom = 0, int top = -1)
+{
+    glm::ivec2 resolution = params.resolution;
+    if (top < 0) top = resolution.y;
+    int halo = job.denoise.enabled ? job.denoise.radius : 0;
+    int bandCount = (top - bottom + height - 1) / height;
+    auto bandY = [&](int band) { return std::max(bottom, top - (band + 1)*height); };
+    auto bandRows = [&](int band) { return top - band*height - bandY(band); };
+    auto startBand = [&](int band)
+    {
+        Tile region = bandRegion(resolution, bandY(band), bandRows(band), halo);
+        if (checkpoint) checkpoint->startBand(params, job.passes, band, region);
+        else renderer.start(params, job.passes, region);
+    };
+
+    int firstBand = checkpoint ? checkpoint->firstBand() : 0;
+    if (firstBand >= bandCount) return true;
+
+    timer.stage("render");
+    startBand(firstBand);
+
+    std::vector<glm::vec4> accumulation;
+    std::vector<float> iterations;
+    std::vector<uint8_t> rgb;
+
+    for (int band = firstBand; band < bandCount; band++)
+    {
+        // Take the finished band and get the workers going on the next one straight away
+        timer.stage("render");
+        renderer.wait();
+        if (checkpoint) checkpoint->endBand();
+        Tile region = renderer.currentRegion();
+        renderer.takeResult(accumulation, iterations);
+        if (band + 1 < bandCount) startBand(band + 1);
+
+        // Resolve and write this band while the next one renders
+        timer.stage("resolve");
+        int firstRow = bandY(band) - region.y;
+        Image::resolve(accumulation, iterations, glm::ivec2(region.width, region.height), firstRow, firstRow + bandRows(band), job.passes, job.denoise, rgb);
+
+        timer.stage("write");
+        if (!write(rgb.data(), bandY(band), bandRows(band))) return false;
+        if (checkpoint) checkpoint->finishBand(rgb.data(), bandRows(band));
+    }
+
+    return true;
+}
+
+// Renders a single (arbitrarily large) image
+int renderImage(const ParamFile::Job &job, StageTimer &timer)
+{
+    glm::ivec2 resolution = job.params.resolution;
+    CpuRenderer renderer(job.threads);
+    Image::StreamWriter writer;
+    if (!writer.open(job.output, resolution, job.compression, pngThreadCount(job))) return 1;
+
+    int height = bandHeight(job, resolution, renderer);
+
+    // Bands a previous run already finished go straight back into the output
+    Checkpoint saved;
+    Checkpoint *checkpoint = job.checkpoint.empty() ? nullptr : &saved;
+    if (checkpoint)
+    {
+        timer.stage("resume");
+        if (!checkpoint->open(job, height, renderer)) return 1;
+        if (!checkpoint->replayRows([&](const uint8_t *rgb, int rows) { return writer.writeRows(rgb, rows); })) return 1;
+    }
+
+    bool ok = renderBands(job, job.params, renderer, timer, height, [&](const uint8_t *rgb, int, int rows)
+    {
+        return writer.writeRows(rgb, rows);
+    }, checkpoint);
+    if (!ok) return 1;
+
+    timer.stage("write");
+    if (!writer.close()) return 1;
+
+    int bandCount = (resolution.y + height - 1) / height;
+    printf("%s: %dx%d, %d pass(es), %d thread(s), %d band(s) of %d rows\n", job.output.c_str(), resolution.x, resolution.y, job.passes, renderer.threadCount(), bandCount, height);
+    if (endsWith(job.output, ".png")) printf("%s: PNG encoded at %.1f MB/s on %d thread(s)\n", job.output.c_str(), writer.megabytesPerSecond(), pngThreadCount(job));
+    if (checkpoint)
+    {
+        printf("%s: %d checkpoint(s) saved, removed now the image is done\n", job.checkpoint.c_str(), checkpoint->savesWritten());
+        checkpoint->remove();
+    }
+    timer.report(stdout);
+
+    return 0;
+}
+
+// Zoom of frame `frame`, growing exponentially up to `job.zoom` on the last frame
+double frameZoom(const ParamFile::Job &job, int frame)
+{
+    double t = job.frames > 1 ? frame / double(job.frames - 1) : 1.0;
+    return pow(job.zoom, t);
+}
+
+// View of frame `frame` of the zoom video, `drift` moves the target into the centre instead of zooming straight into it
+Fractal::Params zoomFrame(const ParamFile::Job &job, int frame, bool drift = true)
+{
+    Fractal::Params params = job.params;
+    glm::dvec2 defaultCenter, defaultDimensions;
+    Fractal::defaultView(params.type, defaultCenter, defaultDimensions);
+
+    double zoom = frameZoom(job, frame);
+    params.dimensions = defaultDimensions / zoom;
+
+    // Offset from the target shrinks like 1/zoom^2, so on screen it shrinks like 1/zoom
+    // (added at double-double precision, deep frames need the target's low halves)
+    if (drift)
+    {
+        glm::dvec2 offset = (defaultCenter - job.params.centerCoords) / (zoom*zoom);
+        DoubleDouble x = DD::add(DoubleDouble(job.params.centerCoords.x, job.params.centerLow.x), offset.x);
+        DoubleDouble y = DD::add(DoubleDouble(job.params.centerCoords.y, job.params.centerLow.y), offset.y);
+        params.centerCoords = glm::dvec2(x.hi, y.hi);
+        params.centerLow = glm::dvec2(x.lo, y.lo);
+    }
+
+    return params;
+}
+
+// Progress and timings go to stderr, stdout may be the video stream
+void reportVideo(const ParamFile::Job &job, const CpuRenderer &renderer, StageTimer &timer)
+{
+    glm::ivec2 resolution = job.params.resolution;
+    fprintf(stderr, "%s: %d frame(s) of %dx%d, %d pass(es), %d thread(s)\n", job.output.c_str(), job.frames, resolution.x, resolution.y, job.passes, renderer.threadCount());
+    double total = timer.report(stderr);
+    fprintf(stderr, "%.2f frames/minute\n", job.frames / (total / 60000.0));
+}
+
+// Renders a zoom video, frame k+1 renders while frame k is resolved and written
+int renderVideo(const ParamFile::Job &job, StageTimer &timer)
+{
+    glm::ivec2 resolution = job.params.resolution;
+    CpuRenderer renderer(job.threads);
+    Image::VideoWriter writer;
+    if (!writer.open(job.output, resolution, job.y4m, job.fps)) return 1;
+
+    timer.stage("render");
+    renderer.start(zoomFrame(job, 0), job.passes);
+
+    std::vector<glm::vec4> accumulation;
+    std::vector<float> iterations;
+    std::vector<uint8_t> rgb;
+
+    for (int frame = 0; frame < job.frames; frame++)
+    {
+        timer.stage("render");
+        renderer.wait();
+        renderer.takeResult(accumulation, iterations);
+        if (frame + 1 < job.frames) renderer.start(zoomFrame(job, frame + 1), job.passes);
+
+        timer.stage("resolve");
+        Image::resolve(accumulation, iterations, resolution, 0, resolution.y, job.passes, job.denoise, rgb);
+
+        timer.stage("write");
+        if (!writer.writeFrame(rgb)) return 1;
+    }
+
+    timer.stage("write");
+    if (!writer.close()) return 1;
+
+    reportVideo(job, renderer, timer);
+    return 0;
+}
+
+// Renders a zoom video from one log-polar strip plus a centre patch, so the render cost is roughly one strip
+// instead of every pixel of every frame. The zoom goes straight into the target since the strip is centred on it
+int renderExpMapVideo(const ParamFile::Job &job, StageTimer &timer)
+{
+    glm::ivec2 resolution = job.params.resolution;
+    CpuRenderer renderer(job.threads);
+    Image::VideoWriter writer;
+    if (!writer.open(job.output, resolution, job.y4m, job.fps)) return 1;
+
+    Fractal::Params lastView = zoomFrame(job, job.frames - 1, false);
+    ExpMap::Layout layout = ExpMap::layout(zoomFrame(job, 0, false), lastView);
+    glm::ivec2 stripSize = layout.strip.resolution;
+    fprintf(stderr, "strip: %dx%d (%.1f frames worth of pixels)\n", stripSize.x, stripSize.y, stripSize.x*(double)stripSize.y / (resolution.x*(double)resolution.y));
+
+    // Keep the resolved rows of both, bottom-up
+    auto keepRows = [](ExpMap::Pyramid &image)
+    {
+        return [&image](const uint8_t *rgb, int y, int rows)
+        {
+            size_t rowSize = (size_t)image.size().x*3;
+            for (int r = 0; r < rows; r++) memcpy(image.row(y + rows - 1 - r), rgb + r*rowSize, rowSize);
+            return true;
+        };
+    };
+
+    ExpMap::Pyramid patch(resolution);
+    if (!renderBands(job, lastView, renderer, timer, bandHeight(job, resolution, renderer), keepRows(patch))) return 1;
+    timer.stage("mipmap");
+    patch.build();
+
+    // Only a window of strip rows around what the current frames read is kept, so memory doesn't grow with the zoom
+    // depth. Windows start on multiples of ALIGN rows, which keeps the mip boxes of most levels in the same place
+    // from one window to the next, and each new one is twice the rows a frame needs so it lasts for a while
+    const int ALIGN = 1024;
+    ExpMap::Pyramid strip(glm::ivec2(stripSize.x, 0), true);
+    int stripBand = bandHeight(job, stripSize, renderer);
+    size_t peakRows = 0;
+
+    std::vector<uint8_t> rgb;
+    for (int frame = 0; frame < job.frames; frame++)
+    {
+        Fractal::Params view = zoomFrame(job, frame, false);
+        glm::ivec2 rows = ExpMap::stripRows(layout, view);
+        if (rows.x < strip.firstRow() || rows.y > strip.endRow())
+        {
+            int first = rows.x / ALIGN*ALIGN;
+            int last = std::min(stripSize.y, rows.y + (rows.y - first));
+            ExpMap::Pyramid window(glm::ivec2(stripSize.x, last - first), true, first);
+
+            // Rows the old window already has are copied over, only the rest is rendered
+            int kept = strip.firstRow() <= first ? glm::clamp(strip.endRow(), first, last) : first;
+            for (int y = first; y < kept; y++) memcpy(window.row(y), strip.row(y), (size_t)stripSize.x*3);
+            if (kept < last && !renderBands(job, layout.strip, renderer, timer, stripBand, keepRows(window), nullptr, kept, last)) return 1;
+
+            timer.stage("mipmap");
+            window.build();
+            strip = std::move(window);
+            peakRows = std::max(peakRows, (size_t)(last - first));
+        }
+
+        timer.stage("resample");
+        ExpMap::composeFrame(layout, strip, patch, lastView, view, renderer.threadCount(), rgb);
+
+        timer.stage("write");
+        if (!writer.writeFrame(rgb)) return 1;
+    }
+
+    timer.stage("write");
+    if (!writer.close()) return 1;
+
+    fprintf(stderr, "strip window: at most %zu rows (%.0f MB)\n", peakRows, peakRows*stripSize.x*3.0*4.0 / 3.0 / 1048576.0);
+    reportVideo(job, renderer, timer);
+    return 0;
+}
+
+// Iteration rate of every precision tier on the job's view, on one thread over a grid of at most 64x64 pixel centres
+// Escape counts are checked against the quad-double ones, the most exact there are
+int benchmarkPrecision(const ParamFile::Job &job, StageTimer &timer)
+{
+    glm::ivec2 resolution = job.params.resolution;
+    glm::ivec2 grid = glm::min(resolution, glm::ivec2(64));
+    std::vector<glm::vec2> coords;
+    for (int y = 0; y < grid.y; y++)
+    {
+        for (int x = 0; x < grid.x; x++) coords.push_back(glm::vec2(x*resolution.x / grid.x + 1.0f, y*resolution.y / grid.y + 1.0f));
+    }
+
+    struct Result { const char *name; double ms; double prepareMs; std::vector<int> iterations; };
+    auto run = [&](const char *name, Precision::Tier tier, bool pairs)
+    {
+        Result result = { name, 0.0, 0.0, std::vector<int>(coords.size()) };
+        Fractal::Params params = job.params;
+        params.precision = tier;
+
+        // The reference orbit is built once per view, timed on its own
+        auto start = std::chrono::steady_clock::now();
+        Fractal::prepare(params);
+        auto prepared = std::chrono::steady_clock::now();
+        result.prepareMs = std::chrono::duration<double, std::milli>(prepared - start).count();
+
+        glm::dvec2 z[2];
+        for (size_t i = 0; i < coords.size(); i++)
+        {
+            if (pairs && i + 1 < coords.size())
+            {
+                Fractal::doubleDoubleIterations(params, &coords[i], z, &result.iterations[i]);
+                i++;
+            }
+            else result.iterations[i] = Fractal::calculateIteration(params, coords[i], z[0]);
+        }
+        result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - prepared).count();
+        return result;
+    };
+
+    timer.stage("benchmark");
+    Result exact = run("Quad-double", Precision::QUAD_DOUBLE, false);
+    std::vector<Result> results = {
+        run("Float", Precision::FLOAT, false),
+        run("Double", Precision::DOUBLE, false),
+        run("Double-double", Precision::DOUBLE_DOUBLE, false),
+        run("DD, SIMD pairs", Precision::DOUBLE_DOUBLE, true),
+        exact,
+        run("Perturbation", Precision::PERTURBATION, false),
+        run("Fixed-point", Precision::FIXED_POINT, false)
+    };
+
+    printf("%dx%d points, %d iterations at most, pixel spacing %.3g (auto picks %s)\n", grid.x, grid.y, job.params.maxIterations,
+        Fractal::pixelSpacing(job.params), Precision::name(Precision::choose(Fractal::pixelSpacing(job.params))));
+    printf("%-16s %12s %10s %10s %12s %10s\n", "precision", "Miter/s", "ms", "vs double", "same as qd", "reference");
+
+    auto rate = [](const Result &result)
+    {
+        double iterations = 0.0;
+        for (int count : result.iterations) iterations += count;
+        return iterations / (result.ms*1000.0);
+    };
+    double doubleRate = rate(results[1]);
+    for (const Result &result : results)
+    {
+        size_t same = 0;
+        for (size_t i = 0; i < coords.size(); i++) same += result.iterations[i] == exact.iterations[i];
+        printf("%-16s %12.2f %10.1f %9.2fx %11.1f%% %8.1f ms\n", result.name, rate(result), result.ms, rate(result) / doubleRate,
+            100.0*same / coords.size(), result.prepareMs);
+    }
+    timer.report(stdout);
+
+    return 0;
+}
+
+// Stores escape data instead of colours, iterating each pixel's centre straight into the mapped file
+int renderIterationFile(const ParamFile::Job &job, StageTimer &timer)
+{
+    IterationFile::File file;
+    if (!file.create(job.output, job.params, job.channels)) return 1;
+
+    int threadCount = jobThreadCount(job);
+    timer.stage("render");
+    file.render(job.params, threadCount);
+
+    timer.stage("write");
+    file.close();
+
+    printf("%s: %dx%d iteration file, %d thread(s)\n", job.output.c_str(), job.params.resolution.x, job.params.resolution.y, threadCount);
+    timer.report(stdout);
+
+    return 0;
+}
+
+// Recolours a stored iteration file with the job's colouring settings, no iterating needed
+int recolourIterationFile(const ParamFile::Job &job, StageTimer &timer)
+{
+    timer.stage("load");
+    IterationFile::File file;
+    if (!file.open(job.input)) return 1;
+
+    Fractal::Params params = job.params;
+    file.viewParams(params);
+    glm::ivec2 resolution = params.resolution;
+
+    Image::StreamWriter writer;
+    if (!writer.open(job.output, resolution, job.compression, pngThreadCount(job))) return 1;
+
+    int threadCount = jobThreadCount(job);
+    const int BAND_ROWS = 256;
+    std::vector<uint8_t> rgb;
+
+    // Top-down bands, like the band renderer
+    for (int top = resolution.y; top > 0; top -= BAND_ROWS)
+    {
+        int bottom = std::max(0, top - BAND_ROWS);
+        rgb.resize((size_t)(top - bottom)*resolution.x*3);
+
+        timer.stage("colour");
+        parallelRows(top - bottom, threadCount, [&](int firstRow, int lastRow)
+        {
+            for (int r = firstRow; r < lastRow; r++)
+            {
+                int y = top - 1 - r;
+                for (int x = 0; x < resolution.x; x++)
+                {
+                    glm::vec3 colour = file.colour(params, (size_t)y*resolution.x + x);
+                    if (params.doGammaCorrection) colour = Fractal::gammaCorrect(colour);
+
+                    uint8_t *out = &rgb[((size_t)r*resolution.x + x)*3];
+                    out[0] = Image::toByte(colour.r);
+                    out[1] = Image::toByte(colour.g);
+                    out[2] = Image::toByte(colour.b);
+                }
+            }
+        });
+
+        timer.stage("write");
+        if (!writer.writeRows(rgb.data(), top - bottom)) return 1;
+    }
+
+    timer.stage("write");
+    if (!writer.close()) return 1;
+
+    printf("%s: %dx%d recoloured from %s, %d thread(s)\n", job.output.c_str(), resolution.x, resolution.y, job.input.c_str(), threadCount);
+    timer.report(stdout);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <parameter file> [key=value ...]" << std::endl;
+        std::cerr << "       " << argv[0] << " --worker <host:port> [key=value ...]" << std::endl;
+        return 1;
+    }
+
+    // Render farm worker, the coordinator sends the job
+    if (strcmp(argv[1], "--worker") == 0)
+    {
+        if (argc < 3)
+        {
+            std::cerr << "Error: --worker needs the coordinator's host:port" << std::endl;
+            return 1;
+        }
+#ifdef _WIN32
+        std::cerr << "Error: farm mode needs POSIX sockets, it isn't available on Windows" << std::endl;
+        return 1;
+#else
+        return Farm::runWorker(argv[2], std::vector<std::string>(argv + 3, argv + argc));
+#endif
+    }
+
+    StageTimer timer;
+
+    // Parameter file, then any overrides from the command line
+    timer.stage("parse");
+    ParamFile::Job job;
+    std::string jobText;
+    if (!ParamFile::load(argv[1], job, &jobText)) return 1;
+    for (int i = 2; i < argc; i++)
+    {
+        if (!ParamFile::parseLine(argv[i], job)) return 1;
+        jobText += std::string(argv[i]) + "\n";
+    }
+    if (!ParamFile::finish(job)) return 1;
+
+    if (job.servePort > 0)
+    {
+#ifdef _WIN32
+        std::cerr << "Error: the tile server needs POSIX sockets, it isn't available on Windows" << std::endl;
+        return 1;
+#else
+        return TileServer(job).run();
+#endif
+    }
+    if (job.farmWorkers > 0 || job.farmPort > 0)
+    {
+#ifdef _WIN32
+        std::cerr << "Error: farm mode needs POSIX sockets, it isn't available on Windows" << std::endl;
+        return 1;
+#else
+        return Farm::runCoordinator(job, jobText, argv[0], timer);
+#endif
+    }
+
+    if (job.benchmark) return benchmarkPrecision(job, timer);
+    if (!job.input.empty()) return recolourIterationFile(job, timer);
+    if (endsWith(job.output, ".iter")) return renderIterationFile(job, timer);
+    if (job.frames <= 0) return renderImage(job, timer);
+    return job.expMap ? renderExpMapVideo(job, timer) : renderVideo(job, timer);
+}
@@ -0,0 +1,336 @@
+#ifndef TILE_SERVER_H
+#define TILE_SERVER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <sstream>
+#include <algorithm>
+#include <unordered_map>
+#include <condition_variable>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "paramFile.h"
+#include "cpuRenderer.h"
+#include "image.h"
+#include "farm.h"
+
+// Slippy map tile server, `GET /z/x/y.png` with parameter file keys in the query (`?iterations=2000&smooth=on`)
+// Zoom 0 is one 256 pixel tile over the fractal's default view, y grows downwards like every XYZ scheme
+// Tiles come from an in-memory LRU cache or get queued for the CPU engine, newest first so panning stays responsive.
+// Concurrent requests for the same tile share one render, and past `serve_inflight` queued tiles new ones get a 503
+class TileServer
+{
+public:
+
+    static constexpr int TILE_PIXELS = 256;
+    static constexpr int MAX_ZOOM = 48;
+    static constexpr int MAX_CONNECTIONS = 256;
+
+    // Most a query may ask for, anything past these renders at the limit
+    static constexpr int MAX_ITERATIONS = 100000;
+    static constexpr int MAX_SAMPLES = 16;
+    static constexpr int MAX_PASSES = 16;
+
+    // Seconds a client may take to send its request
+    static constexpr int RECEIVE_TIMEOUT = 10;
+
+    TileServer(const ParamFile::Job &baseJob)
+        : job(baseJob), renderer(baseJob.threads)
+    {
+        renderThread = std::thread(&TileServer::renderLoop, this);
+    }
+
+    ~TileServer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        work.notify_all();
+        renderThread.join();
+    }
+
+    int run()
+    {
+        int port = job.servePort;
+        int listener = Farm::listenOn(port, "127.0.0.1");
+        if (listener < 0) return 1;
+        fprintf(stderr, "serving tiles on http://127.0.0.1:%d/{z}/{x}/{y}.png with %d thread(s)\n", port, renderer.threadCount());
+
+        while (true)
+        {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd < 0) continue;
+
+            // One short-lived thread per connection, they only parse, wait and send
+            if (++connections > MAX_CONNECTIONS)
+            {
+                respond(fd, 503, "text/plain", "Too many connections\n");
+                connections--;
+                continue;
+            }
+            timeval timeout = { RECEIVE_TIMEOUT, 0 };
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            std::thread(&TileServer::handle, this, fd).detach();
+        }
+    }
+
+private:
+
+    // One tile being rendered, shared by every request waiting on it
+    struct Pending
+    {
+        std::string key;
+        Fractal::Params params;
+        int passes;
+        bool done = false;
+        std::string png;
+    };
+
+    ParamFile::Job job;
+    CpuRenderer renderer;
+    std::thread renderThread;
+    std::atomic<int> connections { 0 };
+
+    // Guarded by `mutex`
+    std::mutex mutex;
+    std::condition_variable work, finished;
+    bool stopping = false;
+    std::deque<std::shared_ptr<Pending>> queue;
+    std::unordered_map<std::string, std::shared_ptr<Pending>> inFlight;
+
+    // LRU cache of encoded tiles, most recent at the front
+    std::list<std::pair<std::string, std::string>> cache;
+    std::unordered_map<std::string, std::list<std::pair<std::string, std::string>>::iterator> cacheIndex;
+
+    static std::string urlDecode(const std::string &text)
+    {
+        std::string out;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            if (text[i] == '+') out += ' ';
+            else if (text[i] == '%' && i + 2 < text.size() && isxdigit(text[i + 1]) && isxdigit(text[i + 2]))
+            {
+                out += (char)strtol(text.substr(i + 1, 2).c_str(), nullptr, 16);
+                i += 2;
+            }
+            else out += text[i];
+        }
+        return out;
+    }
+
+    static const char *statusText(int status)
+    {
+        switch (status)
+        {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        default: return "Service Unavailable";
+        }
+    }
+
+    static void respond(int fd, int status, const char *type, const std::string &body)
+    {
+        char header[256];
+        int length = snprintf(header, sizeof(header),
+            "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n%sAccess-Control-Allow-Origin: *\r\nConnection: close\r\n\r\n",
+            status, statusText(status), type, body.size(), status == 503 ? "Retry-After: 1\r\n" : "");
+        Farm::sendAll(fd, header, length) && Farm::sendAll(fd, body.data(), body.size());
+        close(fd);
+    }
+
+    // Only the keys that change what a tile looks like, the rest of the job is the server's business
+    static bool tileKey(const std::string &key)
+    {
+        static const char *keys[] = { "fractal", "iterations", "lerp", "smooth", "gamma", "gradient_degree", "gradient", "samples", "sampling", "passes" };
+        for (const char *allowed : keys)
+        {
+            if (key == allowed) return true;
+        }
+        return false;
+    }
+
+    // Parses `/z/x/y.png?query` into the tile's view, passes and a canonical cache key, returns the HTTP status
+    int parseTile(const std::string &target, Fractal::Params &params, int &passes, std::string &key)
+    {
+        size_t question = target.find('?');
+        std::string path = target.substr(0, question);
+
+        int z, x, y, consumed = 0;
+        if (sscanf(path.c_str(), "/%d/%d/%d.png%n", &z, &x, &y, &consumed) != 3 || consumed != (int)path.size()) return 404;
+        if (z < 0 || z > MAX_ZOOM || x < 0 || y < 0 || x >= (1ll << z) || y >= (1ll << z)) return 404;
+
+        // Sorted decoded query pairs, so equivalent URLs share cache entries
+        std::map<std::string, std::string> query;
+        std::istringstream pairs(question == std::string::npos ? "" : target.substr(question + 1));
+        std::string pair;
+        while (std::getline(pairs, pair, '&'))
+        {
+            size_t equals = pair.find('=');
+            if (pair.empty()) continue;
+            if (equals == std::string::npos || !tileKey(urlDecode(pair.substr(0, equals)))) return 400;
+            query[urlDecode(pair.substr(0, equals))] = urlDecode(pair.substr(equals + 1));
+        }
+
+        ParamFile::Job tileJob = job;
+        for (auto &entry : query)
+        {
+            if (!ParamFile::parseLine(entry.first + "=" + entry.second, tileJob)) return 400;
+        }
+        params = tileJob.params;
+        passes = tileJob.passes;
+
+        // One request shouldn't tie the renderer up for hours, the key holds the clamped values so they share a tile
+        params.maxIterations = std::min(params.maxIterations, MAX_ITERATIONS);
+        params.samplesPerPixel = std::min(params.samplesPerPixel, MAX_SAMPLES);
+        passes = std::min(passes, MAX_PASSES);
+        if (query.count("iterations")) query["iterations"] = std::to_string(params.maxIterations);
+        if (query.count("samples")) query["samples"] = std::to_string(params.samplesPerPixel);
+        if (query.count("passes")) query["passes"] = std::to_string(passes);
+
+        key = std::to_string(z) + "/" + std::to_string(x) + "/" + std::to_string(y);
+        for (auto &entry : query) key += "&" + entry.first + "=" + entry.second;
+
+        // Square tiles over the default view's larger side, the scheme's y axis points down
+        glm::dvec2 defaultCenter, defaultDimensions;
+        Fractal::defaultView(params.type, defaultCenter, defaultDimensions);
+        double world = std::max(defaultDimensions.x, defaultDimensions.y);
+        double side = world / (double)(1ll << z);
+        params.centerCoords = defaultCenter + glm::dvec2(-world/2.0 + (x + 0.5)*side, world/2.0 - (y + 0.5)*side);
+        params.centerLow = glm::dvec2(0.0);
+        params.dimensions = glm::dvec2(side);
+        params.resolution = glm::ivec2(TILE_PIXELS);
+
+        return params.maxIterations > 0 && params.samplesPerPixel > 0 && passes > 0 && params.gradient.size() >= 2 ? 200 : 400;
+    }
+
+    void handle(int fd)
+    {
+        std::string request;
+        char buffer[2048];
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < 16384)
+        {
+            ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+            if (received <= 0) break;
+            request.append(buffer, received);
+        }
+
+        char method[16], target[8192];
+        Fractal::Params params;
+        int passes;
+        std::string key, png;
+        int status = sscanf(request.c_str(), "%15s %8191s", method, target) == 2 ? 200 : 400;
+        if (status == 200 && strcmp(method, "GET") != 0) status = 405;
+        if (status == 200) status = parseTile(target, params, passes, key);
+        if (status == 200) status = fetch(key, params, passes, png);
+
+        if (status == 200) respond(fd, 200, "image/png", png);
+        else respond(fd, status, "text/plain", std::string(statusText(status)) + "\n");
+        connections--;
+    }
+
+    // Cached tile, or the result of a new or already running render of it
+    int fetch(const std::string &key, const Fractal::Params &params, int passes, std::string &png)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        auto cached = cacheIndex.find(key);
+        if (cached != cacheIndex.end())
+        {
+            cache.splice(cache.begin(), cache, cached->second);
+            png = cached->second->second;
+            return 200;
+        }
+
+        std::shared_ptr<Pending> pending;
+        auto running = inFlight.find(key);
+        if (running != inFlight.end())
+        {
+            pending = running->second;
+        }
+        else
+        {
+            if ((int)inFlight.size() >= job.serveInFlight) return 503;
+
+            pending = std::make_shared<Pending>();
+            pending->key = key;
+            pending->params = params;
+            pending->passes = passes;
+            inFlight[key] = pending;
+            queue.push_back(pending);
+            work.notify_one();
+        }
+
+        finished.wait(lock, [&] { return pending->done; });
+        png = pending->png;
+        return png.empty() ? 503 : 200;
+    }
+
+    void renderLoop()
+    {
+        std::vector<glm::vec4> accumulation;
+        std::vector<float> iterations;
+        std::vector<uint8_t> rgb;
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (true)
+        {
+            work.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) return;
+
+            // Newest first, a map client wants what's on screen now
+            std::shared_ptr<Pending> pending = queue.back();
+            queue.pop_back();
+            lock.unlock();
+
+            renderer.start(pending->params, pending->passes);
+            renderer.wait();
+            renderer.takeResult(accumulation, iterations);
+            Image::resolve(accumulation, iterations, pending->params.resolution, 0, TILE_PIXELS, pending->passes, job.denoise, rgb);
+            std::string png = encodePng(rgb);
+
+            lock.lock();
+            pending->png = png;
+            pending->done = true;
+            inFlight.erase(pending->key);
+            if (!png.empty()) store(pending->key, png);
+            finished.notify_all();
+        }
+    }
+
+    void store(const std::string &key, const std::string &png)
+    {
+        cache.push_front({ key, png });
+        cacheIndex[key] = cache.begin();
+        while ((int)cache.size() > job.serveCacheTiles)
+        {
+            cacheIndex.erase(cache.back().first);
+            cache.pop_back();
+        }
+    }
+
+    std::string encodePng(const std::vector<uint8_t> &rgb)
+    {
+        std::string png;
+        PngEncoder encoder;
+        bool ok = encoder.begin(&png, TILE_PIXELS, TILE_PIXELS, job.compression)
+            && encoder.writeRows(rgb.data(), TILE_PIXELS)
+            && encoder.end();
+        return ok ? png : "";
+    }
+};
+
+#endif
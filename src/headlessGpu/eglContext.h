@@ -0,0 +1,75 @@
+#ifndef EGL_CONTEXT_H
+#define EGL_CONTEXT_H
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <iostream>
+
+// OpenGL core context without any window or surface, rendering only goes to framebuffer objects
+// Uses Mesa's surfaceless platform when available, so it needs neither a display server nor a GPU (llvmpipe takes over,
+// `LIBGL_ALWAYS_SOFTWARE=1` forces it on machines that do have one), and the default display otherwise
+class EglContext
+{
+public:
+
+    EglContext() {}
+    EglContext(const EglContext&) = delete;
+    EglContext &operator=(const EglContext&) = delete;
+
+    ~EglContext()
+    {
+        if (display == EGL_NO_DISPLAY) return;
+
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+        eglTerminate(display);
+    }
+
+    // Creates the context and makes it current on this thread
+    bool create(int major, int minor)
+    {
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay) display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        EGLint versionMajor, versionMinor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &versionMajor, &versionMinor))
+        {
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+            if (display == EGL_NO_DISPLAY || !eglInitialize(display, &versionMajor, &versionMinor)) return fail("no EGL display");
+        }
+
+        if (!eglBindAPI(EGL_OPENGL_API)) return fail("EGL has no desktop OpenGL");
+
+        // Any config that can do desktop GL, none at all is fine too where EGL_KHR_no_config_context is supported
+        const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLConfig config = nullptr;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0) config = nullptr;
+
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, major,
+            EGL_CONTEXT_MINOR_VERSION, minor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (context == EGL_NO_CONTEXT) return fail("could not create an OpenGL context of the requested version");
+
+        // Surfaceless, everything is drawn into FBOs (EGL_KHR_surfaceless_context)
+        if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) return fail("could not make the context current");
+
+        return true;
+    }
+
+private:
+
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    bool fail(const char *reason)
+    {
+        std::cerr << "Error: " << reason << " (EGL error 0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+        return false;
+    }
+};
+
+#endif
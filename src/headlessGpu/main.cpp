@@ -0,0 +1,183 @@
+// Headless GPU renderer, renders a parameter file with the viewer's shaders on an offscreen EGL context
+// On machines without a GPU Mesa's software rasterizer runs the shaders, for regression and throughput comparisons
+// against the CPU engine (`compare_cpu = on`)
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <iostream>
+#include <glad/glad.h>
+#include "eglContext.h"
+#include "paramFile.h"
+#include "programCache.h"
+#include "window.h"
+#include "fullQuad.h"
+#include "renderer.h"
+#include "cpuRenderer.h"
+#include "image.h"
+#include "headless/batch.h"
+
+// Reads the resolved display texture back as top-down RGB
+void readDisplay(const Window &window, std::vector<uint8_t> &rgb)
+{
+    size_t rowSize = (size_t)window.width*3;
+    std::vector<uint8_t> bottomUp(rowSize*window.height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, window.displayFBO);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, window.width, window.height, GL_RGB, GL_UNSIGNED_BYTE, bottomUp.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    rgb.resize(bottomUp.size());
+    for (int y = 0; y < window.height; y++) memcpy(&rgb[(size_t)y*rowSize], &bottomUp[(size_t)(window.height - 1 - y)*rowSize], rowSize);
+}
+
+// Renders the same job with the CPU engine and prints how far the GPU image is from it
+void compareWithCpu(const ParamFile::Job &job, const std::vector<uint8_t> &gpuRgb, StageTimer &timer)
+{
+    timer.stage("cpu render");
+    auto start = std::chrono::steady_clock::now();
+    CpuRenderer renderer(job.threads);
+    renderer.start(job.params, job.passes);
+    renderer.wait();
+
+    std::vector<glm::vec4> accumulation;
+    std::vector<float> iterations;
+    renderer.takeResult(accumulation, iterations);
+
+    timer.stage("cpu resolve");
+    glm::ivec2 resolution = job.params.resolution;
+    std::vector<uint8_t> cpuRgb;
+    Image::resolve(accumulation, iterations, resolution, 0, resolution.y, job.passes, job.denoise, cpuRgb);
+    double cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    int maxDifference = 0;
+    size_t differentPixels = 0;
+    double squaredError = 0.0;
+    for (size_t i = 0; i < cpuRgb.size(); i += 3)
+    {
+        int pixelDifference = 0;
+        for (int c = 0; c < 3; c++)
+        {
+            int difference = abs((int)gpuRgb[i + c] - (int)cpuRgb[i + c]);
+            pixelDifference = std::max(pixelDifference, difference);
+            squaredError += difference*difference;
+        }
+        maxDifference = std::max(maxDifference, pixelDifference);
+        differentPixels += pixelDifference > 0;
+    }
+
+    double mse = squaredError / cpuRgb.size();
+    double pixelCount = (double)resolution.x*resolution.y;
+    printf("cpu: %.3f ms on %d thread(s)\n", cpuMs, renderer.threadCount());
+    printf("gpu vs cpu: %zu pixels (%.3f%%) differ, max difference %d, PSNR %.2f dB\n", differentPixels, 100.0*differentPixels / pixelCount, maxDifference, mse > 0.0 ? 10.0*log10(255.0*255.0 / mse) : INFINITY);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <parameter file> [key=value ...]" << std::endl;
+        return 1;
+    }
+
+    StageTimer timer;
+
+    // Parameter file, then any overrides from the command line
+    timer.stage("parse");
+    ParamFile::Job job;
+    if (!ParamFile::load(argv[1], job)) return 1;
+    for (int i = 2; i < argc; i++)
+    {
+        if (!ParamFile::parseLine(argv[i], job)) return 1;
+    }
+    if (!ParamFile::finish(job)) return 1;
+
+    if (job.frames > 0 || !job.input.empty() || endsWith(job.output, ".iter") || job.farmWorkers > 0 || job.farmPort > 0 || job.servePort > 0)
+    {
+        std::cerr << "Error: the GPU batch renderer only renders single images, use `headless` for everything else" << std::endl;
+        return 1;
+    }
+
+    // The shaders need GLSL 4.50 (llvmpipe's limit), the viewer asks for 4.6 but doesn't need anything newer
+    timer.stage("context");
+    EglContext context;
+    if (!context.create(4, 5)) return 1;
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+    {
+        std::cerr << "Error: could not load the OpenGL functions" << std::endl;
+        return 1;
+    }
+    Shader::enableParallelCompile((GLADloadproc)eglGetProcAddress);
+
+    glm::ivec2 resolution = job.params.resolution;
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    if (resolution.x > maxSize || resolution.y > maxSize)
+    {
+        std::cerr << "Error: " << resolution.x << "x" << resolution.y << " is over the GPU's " << maxSize << " pixel texture limit" << std::endl;
+        return 1;
+    }
+
+    timer.stage("compile");
+    ProgramCache programCache("programCache");
+    Window window(resolution.x, resolution.y);
+    FullQuad quad;
+    quad.init(&programCache);
+    Renderer renderer(&window, &programCache);
+    renderer.setParams(job.params, job.denoise, job.computeTiles);
+    renderer.setComputeBudget(1000.0f);
+    renderer.prepareShaders();
+
+    // The first frame already adds to the other accumulation texture, so both start out empty
+    for (GLuint FBO : window.FBOs)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    glDisable(GL_BLEND);
+
+    // One frame per pass, each adds `samples` samples per pixel like a CPU engine pass
+    // Compute tiles add to the same texture and may take a few frames per pass, however many the budget allows
+    timer.stage("render");
+    auto start = std::chrono::steady_clock::now();
+    bool pingpong = false, latest = false;
+    if (job.computeTiles)
+    {
+        while (renderer.framesSampled() < job.passes) renderer.renderGpuFrame(&window, latest, &quad);
+    }
+    else
+    {
+        for (int pass = 0; pass < job.passes; pass++)
+        {
+            renderer.renderGpuFrame(&window, pingpong, &quad);
+            latest = pingpong;
+            pingpong = !pingpong;
+        }
+    }
+    glFinish();
+    double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    timer.stage("resolve");
+    renderer.resolveToDisplay(&window, latest, &quad);
+    std::vector<uint8_t> rgb;
+    readDisplay(window, rgb);
+
+    timer.stage("write");
+    Image::StreamWriter writer;
+    if (!writer.open(job.output, resolution, job.compression, pngThreadCount(job))) return 1;
+    if (!writer.writeRows(rgb.data(), resolution.y) || !writer.close()) return 1;
+
+    // Grid sampling methods take `samples` squared per pixel
+    int samplesPerPass = job.params.samplingMethod == 0 ? job.params.samplesPerPixel : job.params.samplesPerPixel*job.params.samplesPerPixel;
+    double samples = (double)resolution.x*resolution.y*job.passes*samplesPerPass;
+    printf("%s: %dx%d, %d pass(es) on %s\n", job.output.c_str(), resolution.x, resolution.y, job.passes, (const char*)glGetString(GL_RENDERER));
+    printf("gpu: %.3f ms, %.2f Msamples/s\n", renderMs, samples / (renderMs*1000.0));
+
+    if (job.compareCpu) compareWithCpu(job, rgb, timer);
+    timer.report(stdout);
+
+    return 0;
+}
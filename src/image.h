@@ -0,0 +1,186 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <glm/glm.hpp>
+#include "denoise.h"
+#include "pngEncoder.h"
+
+// Resolving accumulated samples to 8-bit images and writing them to disk
+namespace Image
+{
+    inline uint8_t toByte(float value)
+    {
+        return (uint8_t)(glm::clamp(value, 0.0f, 1.0f)*255.0f + 0.5f);
+    }
+
+    // Resolves rows [firstRow, lastRow) of a `size` buffer to top-down RGB (accumulation rows are bottom-up like GL textures)
+    // `frames` is how many passes the buffer has accumulated, the denoiser fades out with them
+    inline void resolve(const std::vector<glm::vec4> &accumulation, const std::vector<float> &iterations, glm::ivec2 size, int firstRow, int lastRow, int frames, const Denoise::Settings &denoise, std::vector<uint8_t> &rgb)
+    {
+        rgb.resize((size_t)(lastRow - firstRow)*size.x*3);
+        for (int y = firstRow; y < lastRow; y++)
+        {
+            uint8_t *row = &rgb[(size_t)(lastRow - 1 - y)*size.x*3];
+            for (int x = 0; x < size.x; x++)
+            {
+                glm::vec3 colour = Denoise::jointBilateral(accumulation, iterations, size, x, y, frames, denoise);
+                row[x*3 + 0] = toByte(colour.r);
+                row[x*3 + 1] = toByte(colour.g);
+                row[x*3 + 2] = toByte(colour.b);
+            }
+        }
+    }
+
+    // Writes an image top-down a few rows at a time, as binary PPM or (for `.png` paths) PNG deflated on `threadCount` threads
+    class StreamWriter
+    {
+    public:
+
+        ~StreamWriter()
+        {
+            if (file) fclose(file);
+        }
+
+        bool open(const std::string &outputPath, glm::ivec2 resolution, int compressionLevel = 6, int threadCount = 1)
+        {
+            path = outputPath;
+            width = resolution.x;
+            png = path.size() >= 4 && path.compare(path.size() - 4, 4, ".png") == 0;
+
+            file = fopen(path.c_str(), "wb");
+            if (!file)
+            {
+                std::cerr << "Error: could not open `" << path << "` for writing" << std::endl;
+                return false;
+            }
+
+            bool ok = png
+                ? encoder.begin(file, resolution.x, resolution.y, compressionLevel, threadCount)
+                : fprintf(file, "P6\n%d %d\n255\n", resolution.x, resolution.y) > 0;
+            return check(ok);
+        }
+
+        bool writeRows(const uint8_t *rgb, int rows)
+        {
+            auto start = std::chrono::steady_clock::now();
+            size_t size = (size_t)rows*width*3;
+            bool ok = png ? encoder.writeRows(rgb, rows) : fwrite(rgb, 1, size, file) == size;
+
+            bytesWritten += size;
+            writeTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return check(ok);
+        }
+
+        // Uncompressed image data written per second so far, the PNG encoder's throughput for `.png` paths
+        double megabytesPerSecond() const
+        {
+            return writeTime > 0.0 ? bytesWritten / writeTime / 1e6 : 0.0;
+        }
+
+        bool close()
+        {
+            bool ok = !png || encoder.end();
+            ok &= fclose(file) == 0;
+            file = nullptr;
+            return check(ok);
+        }
+
+    private:
+
+        std::string path;
+        FILE *file = nullptr;
+        int width = 0;
+        bool png = false;
+        PngEncoder encoder;
+        size_t bytesWritten = 0;
+        double writeTime = 0.0;
+
+        bool check(bool ok)
+        {
+            if (!ok) std::cerr << "Error: failed writing `" << path << "`" << std::endl;
+            return ok;
+        }
+    };
+
+    // Raw video stream any encoder can read, YUV4MPEG2 (4:4:4, BT.601 limited range) or back to back binary PPM frames
+    // `-` writes to stdout
+    class VideoWriter
+    {
+    public:
+
+        ~VideoWriter()
+        {
+            if (file && file != stdout) fclose(file);
+        }
+
+        bool open(const std::string &outputPath, glm::ivec2 frameResolution, bool y4m, int fps)
+        {
+            path = outputPath;
+            resolution = frameResolution;
+            yuv = y4m;
+
+            file = path == "-" ? stdout : fopen(path.c_str(), "wb");
+            if (!file)
+            {
+                std::cerr << "Error: could not open `" << path << "` for writing" << std::endl;
+                return false;
+            }
+
+            return check(!yuv || fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", resolution.x, resolution.y, fps) > 0);
+        }
+
+        // `rgb` is a top-down RGB frame
+        bool writeFrame(const std::vector<uint8_t> &rgb)
+        {
+            if (!yuv)
+            {
+                bool ok = fprintf(file, "P6\n%d %d\n255\n", resolution.x, resolution.y) > 0;
+                return check(ok && fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size());
+            }
+
+            // Planar Y, Cb, Cr
+            size_t pixels = (size_t)resolution.x*resolution.y;
+            planes.resize(pixels*3);
+            for (size_t i = 0; i < pixels; i++)
+            {
+                int r = rgb[i*3], g = rgb[i*3 + 1], b = rgb[i*3 + 2];
+                planes[i] = (uint8_t)(((66*r + 129*g + 25*b + 128) >> 8) + 16);
+                planes[pixels + i] = (uint8_t)(((-38*r - 74*g + 112*b + 128) >> 8) + 128);
+                planes[2*pixels + i] = (uint8_t)(((112*r - 94*g - 18*b + 128) >> 8) + 128);
+            }
+
+            bool ok = fputs("FRAME\n", file) >= 0;
+            return check(ok && fwrite(planes.data(), 1, planes.size(), file) == planes.size());
+        }
+
+        bool close()
+        {
+            bool ok = fflush(file) == 0;
+            if (file != stdout) ok &= fclose(file) == 0;
+            file = nullptr;
+            return check(ok);
+        }
+
+    private:
+
+        std::string path;
+        FILE *file = nullptr;
+        glm::ivec2 resolution;
+        bool yuv = true;
+        std::vector<uint8_t> planes;
+
+        bool check(bool ok)
+        {
+            if (!ok) std::cerr << "Error: failed writing `" << path << "`" << std::endl;
+            return ok;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,343 @@
+#ifndef ITERATION_FILE_H
+#define ITERATION_FILE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <utility>
+#include <iostream>
+#include <glm/glm.hpp>
+#include "utils.h"
+#include "fractal.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Per pixel escape data on disk, so expensive frames can be recoloured or re-exported without iterating again
+//
+// A 160 byte header holds the view, followed by one plane per channel at 64 byte aligned offsets:
+// iteration counts (int32, always present), smooth iterations (float), distance estimates (float) and final z (2 doubles)
+// Rows are bottom-up like the accumulation buffers. Header and planes are stored in the writer's native byte order
+// (little-endian on every platform this builds for) so readers can map the file and use it as is, a file written with
+// the other byte order fails the version check
+namespace IterationFile
+{
+    enum Channel : uint32_t
+    {
+        SMOOTH = 1,
+        DISTANCE = 2,
+        FINAL_Z = 4,
+        ALL_CHANNELS = SMOOTH | DISTANCE | FINAL_Z,
+    };
+
+    const char MAGIC[8] = { 'F', 'R', 'A', 'C', 'I', 'T', 'E', 'R' };
+    const uint32_t VERSION = 2;
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t channels;
+        int32_t width, height;
+        int32_t type, maxIterations;
+        double center[2];
+        double centerLow[2];  // Low halves of the double-double centre
+        double dimensions[2];
+        double lerpAlpha[2];
+
+        // Byte offsets of each plane from the start of the file, 0 for missing channels
+        uint64_t iterationOffset;
+        uint64_t smoothOffset;
+        uint64_t distanceOffset;
+        uint64_t zOffset;
+        uint64_t fileSize;
+
+        int32_t precision;  // Precision::Tier the file was rendered with, AUTO unless one was forced
+
+        uint8_t reserved[20];
+    };
+    static_assert(sizeof(Header) == 160, "iteration file header layout changed");
+
+    // Whole file mapped into memory, read-only or created read-write at a given size
+    class MappedFile
+    {
+    public:
+
+        MappedFile() {}
+        MappedFile(const MappedFile&) = delete;
+        MappedFile &operator=(const MappedFile&) = delete;
+
+        // Moving hands the mapping over, the moved from file is left closed
+        MappedFile(MappedFile &&other)
+        {
+            swap(other);
+        }
+
+        MappedFile &operator=(MappedFile &&other)
+        {
+            if (this != &other)
+            {
+                close();
+                swap(other);
+            }
+            return *this;
+        }
+
+        ~MappedFile()
+        {
+            close();
+        }
+
+        // `createSize` > 0 creates (or truncates) the file at that size and maps it writable
+        bool open(const std::string &path, size_t createSize = 0)
+        {
+            close();
+            bool create = createSize > 0;
+
+#ifdef _WIN32
+            file = CreateFileA(path.c_str(), create ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ, nullptr, create ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) return fail(path);
+
+            LARGE_INTEGER fileSize;
+            fileSize.QuadPart = (LONGLONG)createSize;
+            if (!create && !GetFileSizeEx(file, &fileSize)) return fail(path);
+            length = (size_t)fileSize.QuadPart;
+            if (length == 0) return fail(path);
+
+            mapping = CreateFileMappingA(file, nullptr, create ? PAGE_READWRITE : PAGE_READONLY, fileSize.HighPart, fileSize.LowPart, nullptr);
+            if (!mapping) return fail(path);
+            address = MapViewOfFile(mapping, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+#else
+            fd = ::open(path.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+            if (fd < 0) return fail(path);
+
+            struct stat info;
+            if (create ? ftruncate(fd, (off_t)createSize) != 0 : fstat(fd, &info) != 0) return fail(path);
+            length = create ? createSize : (size_t)info.st_size;
+            if (length == 0) return fail(path);
+
+            address = mmap(nullptr, length, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+            if (address == MAP_FAILED) address = nullptr;
+#endif
+            return address ? true : fail(path);
+        }
+
+        void close()
+        {
+#ifdef _WIN32
+            if (address) UnmapViewOfFile(address);
+            if (mapping) CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+            mapping = nullptr;
+            file = INVALID_HANDLE_VALUE;
+#else
+            if (address) munmap(address, length);
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+#endif
+            address = nullptr;
+            length = 0;
+        }
+
+        uint8_t *data() const { return (uint8_t*)address; }
+        size_t size() const { return length; }
+
+    private:
+
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#else
+        int fd = -1;
+#endif
+        void *address = nullptr;
+        size_t length = 0;
+
+        void swap(MappedFile &other)
+        {
+#ifdef _WIN32
+            std::swap(file, other.file);
+            std::swap(mapping, other.mapping);
+#else
+            std::swap(fd, other.fd);
+#endif
+            std::swap(address, other.address);
+            std::swap(length, other.length);
+        }
+
+        bool fail(const std::string &path)
+        {
+            std::cerr << "Error: could not map `" << path << "`" << std::endl;
+            close();
+            return false;
+        }
+    };
+
+    // Iterates the centres of rows [firstRow, lastRow) into planes starting at `firstRow`, missing channels are null
+    inline void renderRows(const Fractal::Params &viewParams, int firstRow, int lastRow, int threadCount, int32_t *iteration, float *smooth, float *distance, glm::dvec2 *z)
+    {
+        Fractal::Params params = Fractal::prepared(viewParams);
+        int width = params.resolution.x;
+        parallelRows(lastRow - firstRow, threadCount, [&](int first, int last)
+        {
+            for (int row = first; row < last; row++)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    size_t index = (size_t)row*width + x;
+                    Fractal::Escape result = Fractal::escape(params, glm::vec2(x + 1.0f, firstRow + row + 1.0f));
+                    iteration[index] = result.iteration;
+                    if (smooth) smooth[index] = result.smoothIteration;
+                    if (distance) distance[index] = result.distance;
+                    if (z) z[index] = result.z;
+                }
+            }
+        });
+    }
+
+    // A mapped iteration file, the planes point straight into the mapping
+    class File
+    {
+    public:
+
+        // Maps an existing file, checking the header against the file size
+        bool open(const std::string &path)
+        {
+            if (!mapped.open(path)) return false;
+
+            const Header *h = header();
+            bool ok = mapped.size() >= sizeof(Header)
+                && memcmp(h->magic, MAGIC, sizeof(MAGIC)) == 0
+                && h->version == VERSION
+                && h->width > 0 && h->height > 0
+                && h->type >= Fractal::MANDELBROT && h->type <= Fractal::LERP
+                && h->maxIterations > 0
+                && h->precision >= Precision::AUTO && h->precision < Precision::TIER_COUNT
+                && h->fileSize == mapped.size()
+                && (h->channels & ~ALL_CHANNELS) == 0
+                && h->iterationOffset != 0
+                && planeFits(h->iterationOffset, sizeof(int32_t), true)
+                && planeFits(h->smoothOffset, sizeof(float), has(SMOOTH))
+                && planeFits(h->distanceOffset, sizeof(float), has(DISTANCE))
+                && planeFits(h->zOffset, sizeof(glm::dvec2), has(FINAL_Z));
+            if (!ok)
+            {
+                std::cerr << "Error: `" << path << "` is not a version " << VERSION << " iteration file" << std::endl;
+                mapped.close();
+            }
+            return ok;
+        }
+
+        // Creates a file sized for `params` with the given channels, ready to be filled in
+        bool create(const std::string &path, const Fractal::Params &params, uint32_t channels)
+        {
+            Header h = {};
+            memcpy(h.magic, MAGIC, sizeof(MAGIC));
+            h.version = VERSION;
+            h.channels = channels & ALL_CHANNELS;
+            h.width = params.resolution.x;
+            h.height = params.resolution.y;
+            h.type = params.type;
+            h.maxIterations = params.maxIterations;
+            h.center[0] = params.centerCoords.x; h.center[1] = params.centerCoords.y;
+            h.centerLow[0] = params.centerLow.x; h.centerLow[1] = params.centerLow.y;
+            h.dimensions[0] = params.dimensions.x; h.dimensions[1] = params.dimensions.y;
+            h.lerpAlpha[0] = params.lerpAlpha.x; h.lerpAlpha[1] = params.lerpAlpha.y;
+            h.precision = params.precision;
+
+            // Lay the planes out one after another
+            uint64_t pixels = (uint64_t)h.width*h.height;
+            uint64_t end = sizeof(Header);
+            auto plane = [&](bool present, uint64_t bytes)
+            {
+                if (!present) return (uint64_t)0;
+                uint64_t offset = (end + 63) & ~(uint64_t)63;
+                end = offset + pixels*bytes;
+                return offset;
+            };
+            h.iterationOffset = plane(true, sizeof(int32_t));
+            h.smoothOffset = plane(h.channels & SMOOTH, sizeof(float));
+            h.distanceOffset = plane(h.channels & DISTANCE, sizeof(float));
+            h.zOffset = plane(h.channels & FINAL_Z, sizeof(glm::dvec2));
+            h.fileSize = end;
+
+            if (!mapped.open(path, (size_t)end)) return false;
+            memcpy(mapped.data(), &h, sizeof(Header));
+            return true;
+        }
+
+        void close() { mapped.close(); }
+        bool isOpen() const { return mapped.data() != nullptr; }
+
+        const Header *header() const { return (const Header*)mapped.data(); }
+        glm::ivec2 resolution() const { return glm::ivec2(header()->width, header()->height); }
+        bool has(Channel channel) const { return header()->channels & channel; }
+
+        int32_t *iterations() const { return plane<int32_t>(header()->iterationOffset); }
+        float *smoothIterations() const { return plane<float>(header()->smoothOffset); }
+        float *distances() const { return plane<float>(header()->distanceOffset); }
+        glm::dvec2 *finalZ() const { return plane<glm::dvec2>(header()->zOffset); }
+
+        // The view the file was rendered with, colouring settings are left alone
+        void viewParams(Fractal::Params &params) const
+        {
+            const Header *h = header();
+            params.type = (Fractal::Type)h->type;
+            params.maxIterations = h->maxIterations;
+            params.resolution = glm::ivec2(h->width, h->height);
+            params.centerCoords = glm::dvec2(h->center[0], h->center[1]);
+            params.centerLow = glm::dvec2(h->centerLow[0], h->centerLow[1]);
+            params.dimensions = glm::dvec2(h->dimensions[0], h->dimensions[1]);
+            params.lerpAlpha = glm::dvec2(h->lerpAlpha[0], h->lerpAlpha[1]);
+            params.precision = (Precision::Tier)h->precision;
+        }
+
+        // Pixel `index` coloured with `params`, falls back to plain colouring when there's nothing to smooth with
+        glm::vec3 colour(const Fractal::Params &params, size_t index) const
+        {
+            int iteration = iterations()[index];
+            if (!params.smoothColouring) return Fractal::iterationColour(params, iteration, 0.0f);
+
+            float smoothIter = has(SMOOTH) ? smoothIterations()[index]
+                : has(FINAL_Z) && iteration < params.maxIterations ? Fractal::smoothIteration(finalZ()[index], iteration)
+                : (float)iteration;
+            return Fractal::iterationColour(params, iteration, smoothIter);
+        }
+
+        // Iterates every pixel's centre (like the iteration buffers) straight into the mapped planes
+        void render(const Fractal::Params &params, int threadCount)
+        {
+            renderRows(params, 0, resolution().y, threadCount, iterations(), smoothIterations(), distances(), finalZ());
+        }
+
+    private:
+
+        MappedFile mapped;
+
+        template <typename T>
+        T *plane(uint64_t offset) const
+        {
+            return offset ? (T*)(mapped.data() + offset) : nullptr;
+        }
+
+        // A channel's plane is there exactly when its bit is set, and lies within the file (without the end wrapping around)
+        bool planeFits(uint64_t offset, uint64_t bytes, bool present) const
+        {
+            const Header *h = header();
+            if (!present) return offset == 0;
+
+            uint64_t pixels = (uint64_t)h->width*h->height;
+            return offset % 8 == 0 && offset >= sizeof(Header) && offset <= mapped.size() && pixels <= (mapped.size() - offset) / bytes;
+        }
+    };
+}
+
+#endif
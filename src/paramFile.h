@@ -0,0 +1,353 @@
+#ifndef PARAM_FILE_H
+#define PARAM_FILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "fractal.h"
+#include "denoise.h"
+#include "iterationFile.h"
+#include "pngEncoder.h"
+
+// Render job description for the batch tools, read from `key = value` lines (lines starting with `#` are comments)
+//
+//     # mandelbrot, julia or lerp
+//     fractal    = mandelbrot
+//     center     = -0.745 0.113
+//     zoom       = 250
+//     iterations = 2000
+//     gradient   = #000000 #ff0000 #ffff00 #ffffff
+//     resolution = 3840 2160
+//     samples    = 4
+//     output     = poster.png
+//
+// Images are written in bands of rows, `.png` outputs are PNG (`compression` 0-9 or `rle`), anything else binary PPM
+// PNG rows are deflated in strips on `png_threads` threads (0 uses `threads`)
+// With `checkpoint` set to a path, progress is saved there every `checkpoint_interval` seconds (and on SIGTERM/SIGINT),
+// running the same job again picks up where it stopped, see `headless/checkpoint.h`
+// `precision` (auto, float, double, dd, perturbation, qd or fixed) overrides the arithmetic picked from the pixel spacing, `center`
+// is read at double-double precision for zooms past what a double can place
+// `benchmark` times every tier on the view (iterations per second on one thread) instead of rendering it
+//
+// Setting `frames` renders an exponential zoom video instead, from the default view into `center` at `zoom`
+// It is streamed as `video_format` (y4m or ppm) at `fps` to `output`, which can be `-` for stdout
+// With `exp_map` on, frames are resampled from one log-polar strip rendered along the zoom instead of rendered one by one
+//
+// `.iter` outputs store per pixel escape data (iteration file, `channels` picks smooth, distance and z) instead of colours,
+// `input` recolours a stored iteration file with the colouring settings here, keeping its view and resolution
+//
+// `farm_workers` and/or `farm_port` split the image (or iteration file) across worker processes, see `headless/farm.h`,
+// `farm_port` listens on `farm_bind` (loopback unless set to a machine address or 0.0.0.0) and `threads` stays with each worker
+// `serve_port` serves XYZ map tiles on localhost instead of rendering the job, see `headless/tileServer.h`
+// `compare_cpu` makes the GPU batch renderer (headlessGpu) render the image on the CPU engine too and report the difference,
+// `compute_tiles` renders it with the viewer's compute shader tiles instead of full screen passes
+namespace ParamFile
+{
+    struct Job
+    {
+        Fractal::Params params;
+        double zoom = 1.0;
+        bool centerSet = false;
+        int passes = 1;
+        int threads = 0;
+        Denoise::Settings denoise;
+        std::string output = "fractal.ppm";
+        int compression = 6;
+        int pngThreads = 0;
+        int bandRows = 0;
+
+        // Resumable image renders, off when the path is empty
+        std::string checkpoint;
+        double checkpointInterval = 60.0;
+
+        // Zoom videos, from the default view into `center` at `zoom`
+        int frames = 0;
+        int fps = 30;
+        bool y4m = true;
+        bool expMap = false;
+
+        // Iteration files, `.iter` outputs store escape data instead of colours and `input` recolours a stored one
+        uint32_t channels = IterationFile::ALL_CHANNELS;
+        std::string input;
+
+        // Render farm, local worker processes to spawn and the port remote ones join on (0 means local only),
+        // the address that port listens on and how long a worker may take over one band before it goes to another (0 waits forever)
+        int farmWorkers = 0;
+        int farmPort = 0;
+        std::string farmBind = "127.0.0.1";
+        double farmTimeout = 600.0;
+
+        // Tile server, on when the port is set
+        int servePort = 0;
+        int serveInFlight = 64;
+        int serveCacheTiles = 4096;
+
+        // GPU batch renderer, also render with the CPU engine and compare
+        bool compareCpu = false;
+        bool computeTiles = false;
+
+        // Time every precision tier on the view instead of rendering it
+        bool benchmark = false;
+    };
+
+    inline bool parseColour(const std::string &text, glm::vec3 &colour)
+    {
+        unsigned int hex;
+        if (text.size() != 7 || text[0] != '#' || sscanf(text.c_str() + 1, "%x", &hex) != 1) return false;
+
+        colour = glm::vec3((hex >> 16) & 0xFF, (hex >> 8) & 0xFF, hex & 0xFF) / 255.0f;
+        return true;
+    }
+
+    inline bool parseBool(const std::string &text)
+    {
+        return text == "1" || text == "true" || text == "on" || text == "yes";
+    }
+
+    // Lower case key of a `key = value` line, empty for comments, blank lines and lines without one
+    inline std::string keyOf(const std::string &line)
+    {
+        size_t first = line.find_first_not_of(" \t"), equals = line.find('=');
+        if (first == std::string::npos || line[first] == '#' || equals == std::string::npos) return "";
+
+        std::string key;
+        std::istringstream(line.substr(0, equals)) >> key;
+        std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+        return key;
+    }
+
+    // Applies a single `key = value` line to the job, returns false (and prints why) on errors
+    inline bool parseLine(std::string line, Job &job)
+    {
+        // Whole line comments only, since gradient colours start with `#` too
+        size_t first = line.find_first_not_of(" \t");
+        if (first != std::string::npos && line[first] == '#') return true;
+
+        size_t equals = line.find('=');
+        if (equals == std::string::npos)
+        {
+            // Blank lines are fine, anything else is a typo
+            if (line.find_first_not_of(" \t\r") == std::string::npos) return true;
+            std::cerr << "Error: expected `key = value`, got `" << line << "`" << std::endl;
+            return false;
+        }
+
+        std::string key = keyOf(line), word;
+        std::istringstream value(line.substr(equals + 1));
+        Fractal::Params &params = job.params;
+
+        // `key =` would otherwise leave the default in place without a word
+        if (line.find_first_not_of(" \t\r", equals + 1) == std::string::npos)
+        {
+            std::cerr << "Error: no value for `" << key << "`" << std::endl;
+            return false;
+        }
+
+        if (key == "fractal")
+        {
+            value >> word;
+            if (word == "mandelbrot") params.type = Fractal::MANDELBROT;
+            else if (word == "julia") params.type = Fractal::JULIA;
+            else if (word == "lerp") params.type = Fractal::LERP;
+            else
+            {
+                std::cerr << "Error: unknown fractal `" << word << "`" << std::endl;
+                return false;
+            }
+        }
+        else if (key == "center")
+        {
+            // Read at double-double precision, deep zooms need more digits than a double holds
+            std::string x, y;
+            DoubleDouble centerX, centerY;
+            value >> x >> y;
+            if (!DD::parse(x, centerX) || !DD::parse(y, centerY))
+            {
+                std::cerr << "Error: center needs two numbers, got `" << x << " " << y << "`" << std::endl;
+                return false;
+            }
+            params.centerCoords = glm::dvec2(centerX.hi, centerY.hi);
+            params.centerLow = glm::dvec2(centerX.lo, centerY.lo);
+            job.centerSet = true;
+        }
+        else if (key == "zoom") value >> job.zoom;
+        else if (key == "iterations") value >> params.maxIterations;
+        else if (key == "resolution") value >> params.resolution.x >> params.resolution.y;
+        else if (key == "samples") value >> params.samplesPerPixel;
+        else if (key == "passes") value >> job.passes;
+        else if (key == "threads") value >> job.threads;
+        else if (key == "lerp") value >> params.lerpAlpha.x >> params.lerpAlpha.y;
+        else if (key == "smooth") { value >> word; params.smoothColouring = parseBool(word); }
+        else if (key == "gamma") { value >> word; params.doGammaCorrection = parseBool(word); }
+        else if (key == "gradient_degree") value >> params.gradientDegree;
+        else if (key == "precision")
+        {
+            value >> word;
+            if (word == "auto") params.precision = Precision::AUTO;
+            else if (word == "float") params.precision = Precision::FLOAT;
+            else if (word == "double") params.precision = Precision::DOUBLE;
+            else if (word == "dd" || word == "double-double") params.precision = Precision::DOUBLE_DOUBLE;
+            else if (word == "perturbation") params.precision = Precision::PERTURBATION;
+            else if (word == "qd" || word == "quad-double") params.precision = Precision::QUAD_DOUBLE;
+            else if (word == "fixed" || word == "fixed-point") params.precision = Precision::FIXED_POINT;
+            else
+            {
+                std::cerr << "Error: unknown precision `" << word << "`" << std::endl;
+                return false;
+            }
+        }
+        else if (key == "denoise") { value >> word; job.denoise.enabled = parseBool(word); }
+        else if (key == "output") value >> job.output;
+        else if (key == "png_threads") value >> job.pngThreads;
+        else if (key == "compression")
+        {
+            value >> word;
+            job.compression = word == "rle" ? PngEncoder::RLE : atoi(word.c_str());
+            if (word != "rle" && (word.empty() || word.find_first_not_of("0123456789") != std::string::npos || job.compression > 9))
+            {
+                std::cerr << "Error: compression must be 0-9 or rle, got `" << word << "`" << std::endl;
+                return false;
+            }
+        }
+        else if (key == "band_rows") value >> job.bandRows;
+        else if (key == "checkpoint") value >> job.checkpoint;
+        else if (key == "checkpoint_interval") value >> job.checkpointInterval;
+        else if (key == "frames") value >> job.frames;
+        else if (key == "fps") value >> job.fps;
+        else if (key == "exp_map") { value >> word; job.expMap = parseBool(word); }
+        else if (key == "input") value >> job.input;
+        else if (key == "farm_workers") value >> job.farmWorkers;
+        else if (key == "farm_port") value >> job.farmPort;
+        else if (key == "farm_bind") value >> job.farmBind;
+        else if (key == "farm_timeout") value >> job.farmTimeout;
+        else if (key == "serve_port") value >> job.servePort;
+        else if (key == "serve_inflight") value >> job.serveInFlight;
+        else if (key == "serve_cache") value >> job.serveCacheTiles;
+        else if (key == "compare_cpu") { value >> word; job.compareCpu = parseBool(word); }
+        else if (key == "compute_tiles") { value >> word; job.computeTiles = parseBool(word); }
+        else if (key == "benchmark") { value >> word; job.benchmark = parseBool(word); }
+        else if (key == "channels")
+        {
+            job.channels = 0;
+            while (value >> word)
+            {
+                if (word == "smooth") job.channels |= IterationFile::SMOOTH;
+                else if (word == "distance") job.channels |= IterationFile::DISTANCE;
+                else if (word == "z") job.channels |= IterationFile::FINAL_Z;
+                else if (word != "none")
+                {
+                    std::cerr << "Error: unknown channel `" << word << "`, expected smooth, distance, z or none" << std::endl;
+                    return false;
+                }
+            }
+        }
+        else if (key == "video_format")
+        {
+            value >> word;
+            job.y4m = word == "y4m";
+            if (!job.y4m && word != "ppm")
+            {
+                std::cerr << "Error: unknown video format `" << word << "`" << std::endl;
+                return false;
+            }
+        }
+        else if (key == "sampling")
+        {
+            value >> word;
+            params.doPixelSampling = word != "none";
+            if (word == "random" || word == "none") params.samplingMethod = 0;
+            else if (word == "jittered") params.samplingMethod = 1;
+            else if (word == "grid") params.samplingMethod = 2;
+            else
+            {
+                std::cerr << "Error: unknown sampling method `" << word << "`" << std::endl;
+                return false;
+            }
+        }
+        else if (key == "gradient")
+        {
+            params.gradient.clear();
+            glm::vec3 colour;
+            while (value >> word)
+            {
+                if (!parseColour(word, colour))
+                {
+                    std::cerr << "Error: gradient colours must look like #rrggbb, got `" << word << "`" << std::endl;
+                    return false;
+                }
+                params.gradient.push_back(colour);
+            }
+        }
+        else
+        {
+            std::cerr << "Error: unknown key `" << key << "`" << std::endl;
+            return false;
+        }
+
+        if (value.fail() && !value.eof())
+        {
+            std::cerr << "Error: bad value for `" << key << "`" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    // Fills in everything derived from the parsed values, returns false (and prints why) if the job makes no sense
+    inline bool finish(Job &job)
+    {
+        Fractal::Params &params = job.params;
+
+        glm::dvec2 defaultCenter, defaultDimensions;
+        Fractal::defaultView(params.type, defaultCenter, defaultDimensions);
+        if (!job.centerSet) params.centerCoords = defaultCenter;
+        params.dimensions = defaultDimensions / job.zoom;
+
+        if (params.resolution.x <= 0 || params.resolution.y <= 0 || params.samplesPerPixel <= 0 || job.passes <= 0 || job.zoom <= 0.0)
+        {
+            std::cerr << "Error: resolution, samples, passes and zoom must be positive" << std::endl;
+            return false;
+        }
+        if (params.gradient.size() < 2)
+        {
+            std::cerr << "Error: the gradient needs at least 2 colours" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    // `text` (when given) collects the raw lines, so the job can be handed on to other processes
+    inline bool load(const char *path, Job &job, std::string *text = nullptr)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cerr << "Error: could not open parameter file `" << path << "`" << std::endl;
+            return false;
+        }
+
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(file, line))
+        {
+            lineNumber++;
+            if (text) *text += line + "\n";
+            if (!parseLine(line, job))
+            {
+                std::cerr << "    at " << path << ":" << lineNumber << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef PBO_RING_H
+#define PBO_RING_H
+
+#include <glad/glad.h>
+#include <iostream>
+#include <vector>
+#include "cpuRenderer.h"
+
+// Persistently mapped pixel unpack buffer that the CPU engine's workers write finished tiles into (see TileStaging)
+// Textures are updated from it with glTexSubImage2D, so the GL thread neither copies tiles nor waits for the driver to,
+// and a slot only goes back to the workers once a fence says the uploads reading it are done
+// GL objects are created and deleted on the thread whose context is current, destroy it there too
+class PboRing
+{
+public:
+
+    static constexpr int SLOTS = 128;
+
+    PboRing() {}
+    PboRing(const PboRing&) = delete;
+    PboRing &operator=(const PboRing&) = delete;
+
+    ~PboRing()
+    {
+        for (Batch &batch : batches) glDeleteSync(batch.fence);
+        if (!buffer) return;
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+    }
+
+    // False if the buffer couldn't be mapped, tiles then have to be uploaded from the engine's buffers
+    bool init()
+    {
+        // Coherent, so whatever the workers wrote before a tile was collected is what the upload reads
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLsizeiptr size = SLOTS*TileStaging::SLOT_BYTES;
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+        void *memory = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        if (!memory)
+        {
+            std::cerr << "Error: could not map the tile upload buffer, CPU tiles are uploaded without it" << std::endl;
+            glDeleteBuffers(1, &buffer);
+            buffer = 0;
+            return false;
+        }
+
+        staging.reset(memory, SLOTS);
+        return true;
+    }
+
+    TileStaging &tiles()
+    {
+        return staging;
+    }
+
+    // Hands the slots of finished uploads back to the workers, without waiting for the ones still pending
+    void reclaim()
+    {
+        while (!batches.empty() && glClientWaitSync(batches.front().fence, 0, 0) != GL_TIMEOUT_EXPIRED)
+        {
+            glDeleteSync(batches.front().fence);
+            for (int slot : batches.front().slots) staging.release(slot);
+            batches.erase(batches.begin());
+        }
+    }
+
+    // Copies a collected slot into the textures, the iteration counts only when the tile has new ones
+    void upload(int slot, const Tile &tile, bool hasIterations, GLuint accumulationTexture, GLuint iterationTexture)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+
+        glBindTexture(GL_TEXTURE_2D, accumulationTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, tile.x, tile.y, tile.width, tile.height, GL_RGBA, GL_FLOAT, (const void*)TileStaging::accumulationOffset(slot));
+
+        if (hasIterations)
+        {
+            glBindTexture(GL_TEXTURE_2D, iterationTexture);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, tile.x, tile.y, tile.width, tile.height, GL_RED, GL_FLOAT, (const void*)TileStaging::iterationOffset(slot));
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        uploaded.push_back(slot);
+    }
+
+    // Fences the uploads since the last call, their slots are reclaimed once the GPU has read them
+    void fence()
+    {
+        if (uploaded.empty()) return;
+        batches.push_back({ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), uploaded });
+        uploaded.clear();
+    }
+
+private:
+
+    struct Batch
+    {
+        GLsync fence;
+        std::vector<int> slots;
+    };
+
+    GLuint buffer = 0;
+    TileStaging staging;
+    std::vector<int> uploaded;
+    std::vector<Batch> batches;
+};
+
+#endif
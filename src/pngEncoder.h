@@ -0,0 +1,253 @@
+#ifndef PNG_ENCODER_H
+#define PNG_ENCODER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <zlib.h>
+
+// Streaming 8-bit RGB PNG encoder, rows are compressed as they arrive so the whole image never has to be in memory
+//
+// Each batch of rows is split into strips that are deflated concurrently (one per thread) as raw deflate streams.
+// Every strip ends on a full flush, so it is byte aligned and never refers back into the previous strip: the strips
+// concatenate into one valid zlib stream, and their Adler-32 checksums combine in order
+class PngEncoder
+{
+public:
+
+    // Compressed data gets flushed to the file in IDAT chunks of about this size
+    static constexpr size_t CHUNK_SIZE = 1 << 20;
+
+    // Strips are at least this big, smaller ones cost more in lost matches than the extra thread gains
+    static constexpr size_t MIN_STRIP_SIZE = 256 << 10;
+
+    // Pseudo compression level, run-length only deflate for fast intermediate files (level 0 stores uncompressed)
+    static constexpr int RLE = -2;
+
+    PngEncoder() {}
+    PngEncoder(const PngEncoder&) = delete;
+    PngEncoder &operator=(const PngEncoder&) = delete;
+
+    ~PngEncoder()
+    {
+        endStreams();
+    }
+
+    bool begin(FILE *outFile, int imageWidth, int imageHeight, int level, int threadCount = 1)
+    {
+        file = outFile;
+        buffer = nullptr;
+        return start(imageWidth, imageHeight, level, threadCount);
+    }
+
+    // Encodes into `outBuffer` instead of a file, appending to what's there
+    bool begin(std::string *outBuffer, int imageWidth, int imageHeight, int level, int threadCount = 1)
+    {
+        file = nullptr;
+        buffer = outBuffer;
+        return start(imageWidth, imageHeight, level, threadCount);
+    }
+
+    // `rgb` holds `rows` tightly packed top-down rows
+    bool writeRows(const uint8_t *rgb, int rows)
+    {
+        size_t rowSize = 1 + (size_t)width*3;
+        int stripCount = (int)std::min<size_t>(strips.size(), std::max<size_t>(1, rows*rowSize / MIN_STRIP_SIZE));
+        int stripRows = (rows + stripCount - 1) / stripCount;
+
+        auto deflateStrip = [&](int s)
+        {
+            int first = s*stripRows, last = std::min(rows, first + stripRows);
+            if (first < last) strips[s].deflateRows(rgb + (size_t)first*width*3, last - first, width);
+            else strips[s].output.clear();
+        };
+
+        // The first strip on this thread, the others on their own
+        std::vector<std::thread> threads;
+        for (int s = 1; s < stripCount; s++) threads.emplace_back(deflateStrip, s);
+        deflateStrip(0);
+        for (std::thread &thread : threads) thread.join();
+
+        // Stitch the strips together in order
+        for (int s = 0; s < stripCount; s++)
+        {
+            Strip &strip = strips[s];
+            if (!strip.ok) return false;
+            if (strip.output.empty()) continue;
+
+            adler = adler32_combine(adler, strip.adler, (z_off_t)strip.input.size());
+            if (!append(strip.output.data(), strip.output.size())) return false;
+        }
+
+        rowsWritten += rows;
+        return true;
+    }
+
+    bool end()
+    {
+        if (rowsWritten != height) return false;
+
+        // Empty final block, then the checksum of everything
+        Strip &last = strips[0];
+        uint8_t tail[16];
+        last.stream.next_in = nullptr;
+        last.stream.avail_in = 0;
+        last.stream.next_out = tail;
+        last.stream.avail_out = sizeof(tail) - 4;
+        if (deflate(&last.stream, Z_FINISH) != Z_STREAM_END) return false;
+        size_t size = sizeof(tail) - 4 - last.stream.avail_out;
+        putBigEndian(tail + size, (uint32_t)adler);
+
+        if (!append(tail, size + 4) || !flushCompressed()) return false;
+        endStreams();
+
+        return writeChunk("IEND", nullptr, 0);
+    }
+
+private:
+
+    // One thread's share of a batch of rows, deflated into `output`
+    struct Strip
+    {
+        z_stream stream = {};
+        bool open = false;
+        bool ok = true;
+        uLong adler = 0;
+        std::vector<uint8_t> input, output;
+
+        void deflateRows(const uint8_t *rgb, int rows, int width)
+        {
+            // Filter type 0 (none) in front of every scanline
+            size_t rowSize = (size_t)width*3;
+            input.resize(rows*(rowSize + 1));
+            for (int i = 0; i < rows; i++)
+            {
+                input[i*(rowSize + 1)] = 0;
+                memcpy(&input[i*(rowSize + 1) + 1], rgb + i*rowSize, rowSize);
+            }
+            adler = adler32(adler32(0, nullptr, 0), input.data(), (uInt)input.size());
+
+            // Fresh window per strip, and room for everything up front (the flush marker on top of the bound)
+            ok = deflateReset(&stream) == Z_OK;
+            output.resize(deflateBound(&stream, (uLong)input.size()) + 16);
+            stream.next_in = input.data();
+            stream.avail_in = (uInt)input.size();
+            stream.next_out = output.data();
+            stream.avail_out = (uInt)output.size();
+
+            while (ok)
+            {
+                ok = deflate(&stream, Z_FULL_FLUSH) != Z_STREAM_ERROR;
+                if (stream.avail_in == 0 && stream.avail_out > 0) break;
+
+                // Only if the bound was off, grow and carry on
+                size_t used = output.size() - stream.avail_out;
+                output.resize(output.size()*2);
+                stream.next_out = output.data() + used;
+                stream.avail_out = (uInt)(output.size() - used);
+            }
+            output.resize(output.size() - stream.avail_out);
+        }
+    };
+
+    FILE *file = nullptr;
+    std::string *buffer = nullptr;
+    int width = 0, height = 0, rowsWritten = 0;
+    std::vector<Strip> strips;
+    uLong adler = 0;
+    std::vector<uint8_t> compressed;
+
+    // Signature, header and fresh deflate streams, for either output
+    bool start(int imageWidth, int imageHeight, int level, int threadCount)
+    {
+        width = imageWidth;
+        height = imageHeight;
+        rowsWritten = 0;
+
+        static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        if (!put(signature, 8)) return false;
+
+        // 8-bit depth, truecolour, default compression, filter and interlace methods
+        uint8_t header[13];
+        putBigEndian(header, width);
+        putBigEndian(header + 4, height);
+        header[8] = 8;
+        header[9] = 2;
+        header[10] = header[11] = header[12] = 0;
+        if (!writeChunk("IHDR", header, 13)) return false;
+
+        // One raw deflate stream per thread, the zlib header and checksum are written around them
+        endStreams();
+        strips = std::vector<Strip>(std::max(1, threadCount));
+        for (Strip &strip : strips)
+        {
+            if (deflateInit2(&strip.stream, level == RLE ? 1 : level, Z_DEFLATED, -15, 8, level == RLE ? Z_RLE : Z_DEFAULT_STRATEGY) != Z_OK) return false;
+            strip.open = true;
+        }
+
+        // CMF 0x78 (deflate, 32K window), FLG 0x01 makes the header a multiple of 31 with the fastest level hint
+        compressed.assign({ 0x78, 0x01 });
+        adler = adler32(0, nullptr, 0);
+        return true;
+    }
+
+    static void putBigEndian(uint8_t *out, uint32_t value)
+    {
+        out[0] = value >> 24;
+        out[1] = value >> 16;
+        out[2] = value >> 8;
+        out[3] = value;
+    }
+
+    void endStreams()
+    {
+        for (Strip &strip : strips)
+        {
+            if (strip.open) deflateEnd(&strip.stream);
+            strip.open = false;
+        }
+    }
+
+    bool writeChunk(const char *type, const uint8_t *data, size_t size)
+    {
+        uint8_t length[4], crcBytes[4];
+        putBigEndian(length, (uint32_t)size);
+
+        uLong crc = crc32(0, (const Bytef*)type, 4);
+        if (size) crc = crc32(crc, data, (uInt)size);
+        putBigEndian(crcBytes, (uint32_t)crc);
+
+        return put(length, 4) && put(type, 4) && (size == 0 || put(data, size)) && put(crcBytes, 4);
+    }
+
+    bool put(const void *data, size_t size)
+    {
+        if (buffer)
+        {
+            buffer->append((const char*)data, size);
+            return true;
+        }
+        return fwrite(data, 1, size, file) == size;
+    }
+
+    // Emits an IDAT chunk whenever enough compressed data has piled up
+    bool append(const uint8_t *data, size_t size)
+    {
+        compressed.insert(compressed.end(), data, data + size);
+        return compressed.size() < CHUNK_SIZE || flushCompressed();
+    }
+
+    bool flushCompressed()
+    {
+        if (!compressed.empty() && !writeChunk("IDAT", compressed.data(), compressed.size())) return false;
+        compressed.clear();
+        return true;
+    }
+
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "utils.h"
+
+// Linked program binaries on disk, one file per program, keyed by a hash of the driver strings and the shader sources
+// A driver update changes the key (and drivers reject stale binaries anyway), so old entries just stop being used
+class ProgramCache
+{
+public:
+
+    ProgramCache(const std::string &cacheDirectory)
+        : directory(cacheDirectory)
+    {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        enabled = formats > 0;
+
+        std::error_code error;
+        if (enabled) std::filesystem::create_directories(directory, error);
+
+        const char *strings[] = { (const char*)glGetString(GL_VENDOR), (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION) };
+        for (const char *string : strings) if (string) driver += std::string(string) + "\n";
+    }
+
+    bool isEnabled() const { return enabled; }
+    int hitCount() const { return hits; }
+    int missCount() const { return misses; }
+
+    uint64_t key(const std::string &vertexCode, const std::string &fragmentCode) const
+    {
+        uint64_t hash = hashBytes(driver.data(), driver.size());
+        for (const std::string *code : { &vertexCode, &fragmentCode })
+        {
+            uint64_t size = code->size();
+            hash = hashValue(size, hash);
+            hash = hashBytes(code->data(), code->size(), hash);
+        }
+        return hash;
+    }
+
+    // Loads the binary into `program`, false (with the program left unlinked) when there is none or the driver refuses it
+    bool load(uint64_t key, GLuint program)
+    {
+        if (!enabled) return false;
+
+        BinaryHeader header;
+        std::vector<uint8_t> binary;
+        FILE *file = fopen(path(key).c_str(), "rb");
+        bool ok = file && fread(&header, sizeof(header), 1, file) == 1
+            && memcmp(header.magic, "FRACPROG", 8) == 0 && header.key == key && header.length > 0;
+        if (ok)
+        {
+            binary.resize(header.length);
+            ok = fread(binary.data(), 1, binary.size(), file) == binary.size();
+        }
+        if (file) fclose(file);
+
+        GLint linked = GL_FALSE;
+        if (ok)
+        {
+            glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        }
+
+        if (linked == GL_TRUE) hits++;
+        else misses++;
+        return linked == GL_TRUE;
+    }
+
+    void store(uint64_t key, GLuint program)
+    {
+        if (!enabled) return;
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+
+        BinaryHeader header;
+        memcpy(header.magic, "FRACPROG", 8);
+        header.key = key;
+        std::vector<uint8_t> binary(length);
+        glGetProgramBinary(program, length, &length, &header.format, binary.data());
+        header.length = (uint32_t)length;
+
+        // Write to a temporary name first so a crash never leaves a torn binary behind
+        std::string finalPath = path(key), temporaryPath = finalPath + ".part";
+        FILE *file = fopen(temporaryPath.c_str(), "wb");
+        if (!file) return;
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(binary.data(), 1, header.length, file) == header.length;
+        ok &= fclose(file) == 0;
+
+        std::error_code error;
+        if (ok) std::filesystem::rename(temporaryPath, finalPath, error);
+        if (!ok || error) std::filesystem::remove(temporaryPath, error);
+    }
+
+private:
+
+    struct BinaryHeader
+    {
+        char magic[8];
+        uint64_t key;
+        GLenum format;
+        uint32_t length;
+    };
+
+    std::string directory;
+    std::string driver;
+    bool enabled = false;
+    int hits = 0, misses = 0;
+
+    std::string path(uint64_t key) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return directory + "/" + name;
+    }
+};
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef QUAD_DOUBLE_H
+#define QUAD_DOUBLE_H
+
+#include "doubleDouble.h"
+
+// Unevaluated sum of four doubles, about 212 bits of mantissa (the QD library's "sloppy" operations, see doubleDouble.h)
+// Largest part first, each part no more than half an ulp of the one before
+struct QuadDouble
+{
+    double x[4] = { 0.0, 0.0, 0.0, 0.0 };
+
+    QuadDouble() {}
+    QuadDouble(double value) { x[0] = value; }
+    QuadDouble(DoubleDouble value) { x[0] = value.hi; x[1] = value.lo; }
+    QuadDouble(double x0, double x1, double x2, double x3) { x[0] = x0; x[1] = x1; x[2] = x2; x[3] = x3; }
+
+    double value() const { return x[0] + (x[1] + (x[2] + x[3])); }
+};
+
+namespace QD
+{
+    // a + b = s + e exactly, in place: a becomes the sum and b the error
+    inline void twoSum(double &a, double &b)
+    {
+        DoubleDouble s = DD::twoSum(a, b);
+        a = s.hi;
+        b = s.lo;
+    }
+
+    inline void quickTwoSum(double &a, double &b)
+    {
+        DoubleDouble s = DD::quickTwoSum(a, b);
+        a = s.hi;
+        b = s.lo;
+    }
+
+    // a + b + c as three non-overlapping parts in a, b and c
+    inline void threeSum(double &a, double &b, double &c)
+    {
+        double t1 = a, t2 = b;
+        twoSum(t1, t2);
+        double t3 = t1;
+        a = c;
+        twoSum(a, t3);
+        b = t2;
+        c = t3;
+        twoSum(b, c);
+    }
+
+    // a + b + c as two parts in a and b, c is left alone
+    inline void threeSum2(double &a, double &b, double c)
+    {
+        double t1 = a, t2 = b;
+        twoSum(t1, t2);
+        double t3 = t1;
+        a = c;
+        twoSum(a, t3);
+        b = t2 + t3;
+    }
+
+    // Five overlapping parts down to four that aren't
+    inline QuadDouble renormalize(double c0, double c1, double c2, double c3, double c4)
+    {
+        quickTwoSum(c3, c4);
+        quickTwoSum(c2, c3);
+        quickTwoSum(c1, c2);
+        quickTwoSum(c0, c1);
+
+        // Fold the remaining parts in from the top, skipping any that vanished
+        double s[4] = { c0, c1, 0.0, 0.0 };
+        const double rest[3] = { c2, c3, c4 };
+        int k = s[1] != 0.0 ? 1 : 0;
+        for (int i = 0; i < 3; i++)
+        {
+            double e = rest[i];
+            if (k == 3)
+            {
+                s[3] += e;
+                continue;
+            }
+            quickTwoSum(s[k], e);
+            s[k + 1] = e;
+            if (e != 0.0) k++;
+        }
+        return QuadDouble(s[0], s[1], s[2], s[3]);
+    }
+
+    inline QuadDouble add(const QuadDouble &a, const QuadDouble &b)
+    {
+        double s0 = a.x[0], t0 = b.x[0], s1 = a.x[1], t1 = b.x[1];
+        double s2 = a.x[2], t2 = b.x[2], s3 = a.x[3], t3 = b.x[3];
+        twoSum(s0, t0);
+        twoSum(s1, t1);
+        twoSum(s2, t2);
+        twoSum(s3, t3);
+
+        twoSum(s1, t0);
+        threeSum(s2, t0, t1);
+        threeSum2(s3, t0, t2);
+        t0 = t0 + t1 + t3;
+        return renormalize(s0, s1, s2, s3, t0);
+    }
+
+    inline QuadDouble negate(const QuadDouble &a)
+    {
+        return QuadDouble(-a.x[0], -a.x[1], -a.x[2], -a.x[3]);
+    }
+
+    inline QuadDouble sub(const QuadDouble &a, const QuadDouble &b)
+    {
+        return add(a, negate(b));
+    }
+
+    inline QuadDouble mul(const QuadDouble &a, double b)
+    {
+        DoubleDouble p0 = DD::twoProduct(a.x[0], b), p1 = DD::twoProduct(a.x[1], b), p2 = DD::twoProduct(a.x[2], b);
+        double p3 = a.x[3]*b;
+
+        double s1 = p0.lo, s2 = p1.hi;
+        twoSum(s1, s2);
+        double q1 = p1.lo, r2 = p2.hi;
+        threeSum(s2, q1, r2);
+        double q2 = p2.lo;
+        threeSum2(q1, q2, p3);
+        return renormalize(p0.hi, s1, s2, q1, q2 + r2);
+    }
+
+    inline QuadDouble mul(const QuadDouble &a, const QuadDouble &b)
+    {
+        // Products of parts down to the third order, the fourth order ones only as plain doubles
+        DoubleDouble p0 = DD::twoProduct(a.x[0], b.x[0]);
+        DoubleDouble p1 = DD::twoProduct(a.x[0], b.x[1]), p2 = DD::twoProduct(a.x[1], b.x[0]);
+        DoubleDouble p3 = DD::twoProduct(a.x[0], b.x[2]), p4 = DD::twoProduct(a.x[1], b.x[1]), p5 = DD::twoProduct(a.x[2], b.x[0]);
+
+        double q0 = p0.lo, h1 = p1.hi, h2 = p2.hi;
+        threeSum(h1, h2, q0);
+
+        // Six-three sum of (h2, p1.lo, p2.lo) and (p3, p4, p5)
+        double q1 = p1.lo, q2 = p2.lo, h3 = p3.hi, h4 = p4.hi, h5 = p5.hi;
+        threeSum(h2, q1, q2);
+        threeSum(h3, h4, h5);
+        double s0 = h2, e0 = h3, s1 = q1, e1 = h4;
+        twoSum(s0, e0);
+        twoSum(s1, e1);
+        double s2 = q2 + h5;
+        twoSum(s1, e0);
+        s2 += e0 + e1;
+
+        s1 += a.x[0]*b.x[3] + a.x[1]*b.x[2] + a.x[2]*b.x[1] + a.x[3]*b.x[0] + q0 + p3.lo + p4.lo + p5.lo;
+        return renormalize(p0.hi, h1, s0, s1, s2);
+    }
+
+    inline QuadDouble sqr(const QuadDouble &a)
+    {
+        return mul(a, a);
+    }
+
+    // Exact, scaling by a power of two never rounds
+    inline QuadDouble twice(const QuadDouble &a)
+    {
+        return QuadDouble(2.0*a.x[0], 2.0*a.x[1], 2.0*a.x[2], 2.0*a.x[3]);
+    }
+}
+
+#endif
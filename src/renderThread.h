@@ -0,0 +1,257 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <glm/glm.hpp>
+#include "programCache.h"
+#include "window.h"
+#include "fullQuad.h"
+#include "renderer.h"
+#include "tripleBuffer.h"
+
+// Renders the viewport on its own thread and GL context, so a slow frame never holds up the UI or its input
+// Finished frames are copied into display textures handed over through a triple buffer, and the UI thread shows the
+// newest one at display rate. The renderer lives on this thread's context (queries, framebuffers and vertex arrays
+// aren't shared between contexts), the UI thread edits it between frames while holding `lock()`. The slow part of a
+// frame works from a snapshot of the settings outside the lock
+class RenderThread
+{
+public:
+
+    // A finished frame, the texture belongs to the UI thread until it takes a newer one
+    // `drawn` fences the UI's last draw of it, the render thread waits for that before copying a new frame in
+    struct Frame
+    {
+        GLuint texture = 0;
+        int width = 0, height = 0;
+        GLsync drawn = 0;
+    };
+
+    RenderThread() {}
+    RenderThread(const RenderThread&) = delete;
+    RenderThread &operator=(const RenderThread&) = delete;
+
+    ~RenderThread()
+    {
+        stop();
+    }
+
+    // `context` is a (hidden) window sharing objects with the UI's context, GLFW only creates those on the main thread
+    // Returns once the renderer is set up, its programs compiled or loaded from `programCache`
+    void start(GLFWwindow *context, glm::ivec2 resolution, ProgramCache *programCache)
+    {
+        this->context = context;
+        this->programCache = programCache;
+        requestedResolution = resolution;
+        running = true;
+        thread = std::thread(&RenderThread::run, this);
+
+        std::unique_lock<std::mutex> guard(mutex);
+        initializedCondition.wait(guard, [this] { return initialized; });
+    }
+
+    void stop()
+    {
+        if (!thread.joinable()) return;
+        running = false;
+        thread.join();
+    }
+
+    // Held by the UI thread while it uses `renderer()`, the render thread holds it to snapshot the settings and while
+    // it records a frame
+    std::unique_lock<std::mutex> lock()
+    {
+        return std::unique_lock<std::mutex>(mutex);
+    }
+
+    Renderer &renderer()
+    {
+        return sceneRenderer;
+    }
+
+    // Viewport size for the next frames, under `lock()`
+    void resize(glm::ivec2 resolution)
+    {
+        requestedResolution = resolution;
+    }
+
+    // The newest finished frame (UI thread)
+    const Frame &latestFrame()
+    {
+        frames.update();
+        return frames.front();
+    }
+
+    // Fences the draws showing the latest frame (UI thread, once they're submitted). The slot goes back to the render
+    // thread with a later `latestFrame()`, and isn't overwritten before the GPU is done sampling it
+    void frameDrawn()
+    {
+        Frame &frame = frames.front();
+        if (frame.drawn) glDeleteSync(frame.drawn);
+        frame.drawn = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        // The render thread's context can only wait on a fence that was flushed
+        glFlush();
+    }
+
+    // Wall time of the last frame, recording it plus the GPU's time on it
+    double frameMs() const
+    {
+        return lastFrameMs;
+    }
+
+private:
+
+    GLFWwindow *context = nullptr;
+    ProgramCache *programCache = nullptr;
+    std::thread thread;
+    std::atomic<bool> running { false };
+
+    std::mutex mutex;
+    std::condition_variable initializedCondition;
+    bool initialized = false;
+    glm::ivec2 requestedResolution;
+
+    // Only touched by the render thread
+    Window sceneWindow;
+    FullQuad quad;
+    Renderer sceneRenderer;
+    bool pingpong = false;
+
+    TripleBuffer<Frame> frames;
+    std::atomic<double> lastFrameMs { 0.0 };
+
+    void run()
+    {
+        glfwMakeContextCurrent(context);
+        Shader::enableParallelCompile((GLADloadproc)glfwGetProcAddress);
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            sceneWindow = Window(requestedResolution.x, requestedResolution.y);
+            quad.init(programCache);
+            sceneRenderer = Renderer(&sceneWindow, programCache);
+            for (int i = 0; i < 3; i++) glGenTextures(1, &frames.slot(i).texture);
+            initialized = true;
+        }
+        initializedCondition.notify_all();
+
+        while (running)
+        {
+            // One frame per frame the UI shows at most, rendering more would only take GPU time from the UI
+            if (frames.pending())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            // The lock only covers taking a snapshot and recording commands. Reference orbits, recolouring an iteration
+            // file and linking shaders are prepared from the snapshot without it, and the frame renders that snapshot
+            // even if the settings changed meanwhile, so input that never stops still gets frames. The next one catches up
+            auto start = std::chrono::steady_clock::now();
+            Renderer::Snapshot snapshot;
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                if (requestedResolution != sceneWindow.resolution())
+                {
+                    sceneWindow.updateDimensions(requestedResolution.x, requestedResolution.y);
+                    sceneRenderer.setResolution(requestedResolution);
+                }
+                snapshot = sceneRenderer.snapshot();
+            }
+            sceneRenderer.prepare(snapshot);
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                sceneRenderer.renderFrom(snapshot);
+                renderFrame();
+            }
+
+            // The GPU catches up outside the lock. Resolving samples what was just rendered, which some drivers wait
+            // for right there, so it waits for the GPU in between as well
+            waitForGpu();
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                resolveFrame();
+            }
+            if (!waitForGpu()) break;
+
+            lastFrameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            frames.publish();
+        }
+
+        sceneRenderer.releaseCpuEngine();
+        for (int i = 0; i < 3; i++)
+        {
+            glDeleteTextures(1, &frames.slot(i).texture);
+            if (frames.slot(i).drawn) glDeleteSync(frames.slot(i).drawn);
+        }
+        glfwMakeContextCurrent(nullptr);
+    }
+
+    // Blocks until the GPU has finished everything submitted so far, false if the thread was stopped meanwhile
+    bool waitForGpu()
+    {
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        while (running && glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+        glDeleteSync(fence);
+        return running;
+    }
+
+    // Renders the renderer's next frame into the window's accumulation textures
+    void renderFrame()
+    {
+        // This context never blends, the alpha channel of the accumulation textures holds the per-pixel sample count
+        if (sceneRenderer.showingIterationFile())
+        {
+            // A loaded iteration file is coloured on the CPU, nothing to render
+            sceneRenderer.renderIterationFile(sceneWindow.textures[pingpong], sceneWindow.iterationTexture);
+        }
+        else if (sceneRenderer.usingCpuEngine())
+        {
+            // The CPU engine renders in the background, upload the tiles that finished since the last frame
+            sceneRenderer.renderCpu(sceneWindow.textures[pingpong], sceneWindow.iterationTexture);
+        }
+        else
+        {
+            sceneRenderer.renderGpuFrame(&sceneWindow, pingpong, &quad);
+        }
+    }
+
+    // Resolves the frame and copies the result into the triple buffer's back slot
+    void resolveFrame()
+    {
+        // Resolve (and optionally denoise) the accumulated samples into the 8-bit display texture
+        sceneRenderer.resolveToDisplay(&sceneWindow, pingpong, &quad);
+
+        // The display texture is overwritten next frame, the UI gets a copy of its own. The GPU waits for the UI's
+        // last draw of this slot first, the CPU carries on
+        Frame &frame = frames.back();
+        if (frame.drawn)
+        {
+            glWaitSync(frame.drawn, 0, GL_TIMEOUT_IGNORED);
+            glDeleteSync(frame.drawn);
+            frame.drawn = 0;
+        }
+        if (frame.width != sceneWindow.width || frame.height != sceneWindow.height)
+        {
+            frame.width = sceneWindow.width;
+            frame.height = sceneWindow.height;
+            glBindTexture(GL_TEXTURE_2D, frame.texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, frame.width, frame.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        glCopyImageSubData(sceneWindow.displayTexture, GL_TEXTURE_2D, 0, 0, 0, 0, frame.texture, GL_TEXTURE_2D, 0, 0, 0, 0, frame.width, frame.height, 1);
+
+        // The CPU paths and compute tiles keep adding to the same texture
+        if (!sceneRenderer.accumulatesInPlace()) pingpong = !pingpong;
+    }
+};
+
+#endif
@@ -1,14 +1,29 @@
 #ifndef RENDERER_H
 #define RENDERER_H
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <string>
 #include <vector>
+#include <memory>
+#include <thread>
+#include <iostream>
 #include <glm/glm.hpp>
 #include <imgui/imgui.h>
 #include <imgui/imgui_double.h>
 #include "utils.h"
 #include "shader.h"
+#include "shaderVariants.h"
+#include "tileScheduler.h"
+#include "uniformBuffer.h"
+#include "window.h"
 #include "fullQuad.h"
+#include "denoise.h"
+#include "cpuRenderer.h"
+#include "pboRing.h"
+#include "iterationFile.h"
+#include "tileCache.h"
 
 #define SHOW_VEC2I(NAME, V) ImGui::Text(NAME ": %d, %d", V.x, V.y);
 #define SHOW_VEC2D(NAME, V) ImGui::Text(NAME ": %Lf, %Lf", V.x, V.y);
@@ -19,10 +34,26 @@ public:
     
     Renderer () {}
 
-    Renderer(const Window *window)
+    Renderer(const Window *window, ProgramCache *programCache = nullptr)
+        : programCache(programCache)
     {
-        // Compile and link shader programs
-        shader = Shader("./src/shaders/quad.vert", "./src/shaders/main.frag");
+        // Compile and link shader programs (or load them from the binary cache)
+        claimPrograms();
+        sceneShaders = ShaderVariants("./src/shaders/quad.vert", "./src/shaders/main.frag", programCache);
+        resolveShader = Shader("./src/shaders/quad.vert", "./src/shaders/quad.frag", "", programCache);
+
+        settings.init(SETTINGS_BINDING);
+        if (sceneShaders.genericProgram().uniformBlockSize("Settings") != (GLint)sizeof(SettingsBlock))
+        {
+            std::cerr << "Error: `Settings` block in main.frag doesn't match Renderer::SettingsBlock" << std::endl;
+            exit(1);
+        }
+
+        glGenQueries(1, &resolveTimeQuery);
+
+        // Reference orbit for the perturbation tier, refilled whenever the view changes while it's in use
+        glGenBuffers(1, &referenceBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, REFERENCE_BINDING, referenceBuffer);
 
         setResolution(window->resolution());
         resetDefaultFractalValues();
@@ -30,51 +61,498 @@ public:
         initGradient();
     }
 
+    // The frames start over from the new settings, once they render them (see restartIfUpdated())
     void onUpdate()
     {
-        renderedFrameCount = 0;
         skipAA = 2;  // Skip anti aliasing for the next 2 frames
+        updates++;
+    }
+
+    // What a frame needs from the settings, copied under the render thread's lock so prepare() can work without it
+    struct Snapshot
+    {
+        uint64_t updates = 0;
+        Fractal::Params params;
+        std::shared_ptr<IterationFile::File> iterationFile;
+        bool linkShaders = false, compute = false;
+        std::string defines[2];
+    };
+
+    Snapshot snapshot()
+    {
+        updateView();
+
+        Snapshot snapshot;
+        snapshot.updates = updates;
+        snapshot.params = fractalParams();
+        snapshot.iterationFile = iterationFile;
+        snapshot.linkShaders = useShaderVariants && !useCpuEngine && !showingIterationFile();
+        snapshot.compute = useComputeShader;
+        snapshot.defines[0] = shaderDefines(snapshot.params, false);
+        snapshot.defines[1] = shaderDefines(snapshot.params, true);
+        return snapshot;
+    }
+
+    // The slow part of a frame, done from `snapshot` while the UI keeps the settings: the reference orbit, colouring a
+    // loaded iteration file and linking new shader variants
+    // The programs are only ever touched by the thread rendering, which is why this can link them without the lock
+    void prepare(const Snapshot &snapshot)
+    {
+        claimPrograms();
+        if (preparedFrame.updates == snapshot.updates) return;
+        preparedFrame.updates = snapshot.updates;
+        preparedFrame.referenceOrbit.reset();
+        preparedFrame.accumulation.clear();
+        preparedFrame.iterations.clear();
+
+        if (snapshot.iterationFile)
+        {
+            colourIterationFile(*snapshot.iterationFile, snapshot.params, preparedFrame.accumulation, preparedFrame.iterations);
+        }
+        else
+        {
+            preparedFrame.referenceOrbit = Fractal::prepared(snapshot.params).referenceOrbit;
+        }
+
+        if (snapshot.linkShaders)
+        {
+            if (snapshot.compute) initCompute();
+            ShaderVariants &variants = snapshot.compute ? *computeShaders : sceneShaders;
+            variants.link(snapshot.defines[0]);
+            variants.link(snapshot.defines[1]);
+        }
+    }
+
+    // Renders the following frames from `snapshot` rather than from the current settings, so the frame that was just
+    // prepared gets shown even when the settings moved on meanwhile. The next snapshot catches up with them
+    void renderFrom(const Snapshot &snapshot)
+    {
+        frame = snapshot;
+        framePinned = true;
+    }
+
+    bool usingCpuEngine() const
+    {
+        return useCpuEngine;
+    }
+
+    // Stops the CPU engine's workers and frees its upload buffer, while the context that created it is still current
+    void releaseCpuEngine()
+    {
+        cpuRenderer.reset();
+        tileUploads.reset();
+    }
+
+    // Whether frames add to the accumulation texture they were resolved from rather than the other one
+    bool accumulatesInPlace() const
+    {
+        return useCpuEngine || useComputeShader || showingIterationFile();
+    }
+
+    bool needsEdgePrepass() const
+    {
+        if (useCpuEngine) return false;
+
+        bool needsIterations = (doEdgeDirectedSampling && doPixelSampling) || denoise.enabled;
+        return needsIterations && !edgePrepassDone;
+    }
+
+    void renderEdgePrepass(FullQuad *quad)
+    {
+        // Same uniforms as the scene, but only write single sample iteration counts
+        Shader &shader = sceneShader();
+        shader.use();
+        setSettingsUniforms(shader, 0, 1);
+        shader.setBool("edgePrepass", true);
+        quad->render();
+        shader.setBool("edgePrepass", false);
+
+        edgePrepassDone = true;
     }
     
-    void renderScene(int prevTextureUnit, FullQuad *quad)
+    void renderScene(int prevTextureUnit, int iterationTextureUnit, FullQuad *quad)
     {
+        doTemporalAntiAliasing = skipAA ? --skipAA > 1 : doTAA;
+
         // Set uniforms
-        setSettingsUniforms(prevTextureUnit);
-        setGradientUniforms();
+        Shader &shader = sceneShader();
+        shader.use();
+        setSettingsUniforms(shader, prevTextureUnit, iterationTextureUnit);
 
         // Render scene
-        shader.use();
         quad->render();
 
         renderedFrameCount++;
     }
 
-    void resetDefaultFractalValues()
+    // Finishes compiling the shader variants for the current settings now rather than while frames render
+    void prepareShaders()
     {
-        switch (fractalType)
+        if (!useShaderVariants) return;
+        claimPrograms();
+        updateView();
+        Fractal::Params params = fractalParams();
+        sceneShaders.ready(shaderDefines(params, true));
+        sceneShaders.ready(shaderDefines(params, false));
+
+        if (!useComputeShader) return;
+        initCompute();
+        computeShaders->ready(shaderDefines(params, true));
+        computeShaders->ready(shaderDefines(params, false));
+    }
+
+    // Renders a GPU frame into `window`'s accumulation texture `pingpong`, adding to the other one's samples
+    // (or to its own, in tiles, with the compute shader)
+    void renderGpuFrame(const Window *window, bool pingpong, FullQuad *quad)
+    {
+        restartIfUpdated();
+        if (useComputeShader)
         {
-        case MANDELBROT:
+            renderCompute(window, pingpong);
+            return;
+        }
 
-            defaultDimensions = glm::dvec2(2.47, 2.24);
-            defaultCenter = glm::dvec2(-0.765, 0.0);
-            
-        break;
-        case JULIA:
+        // Single sample prepass for edge-directed sampling, only needed once per view
+        if (needsEdgePrepass())
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, window->iterationFBO);
+            glViewport(0, 0, window->width, window->height);
+            renderEdgePrepass(quad);
+        }
 
-            defaultDimensions = glm::dvec2(3.0, 2.0);
-            defaultCenter = glm::dvec2(0.0, 0.0);
+        // Iteration counts from the prepass go on texture unit 1
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, window->iterationTexture);
 
-        break;
-        case LERP:
+        // Get previous frame texture unit and bind it (this way we can use it in the scene shader)
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, window->textures[!pingpong]);
 
-            defaultDimensions = glm::dvec2(3.0, 2.0);
-            defaultCenter = glm::dvec2(0.0, 0.0);
-        
-        break;
+        // Bind and clear current frame buffer (this way anything we render gets rendered on this FBO's texture)
+        glBindFramebuffer(GL_FRAMEBUFFER, window->FBOs[pingpong]);
+        glViewport(0, 0, window->width, window->height);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        // Render the scene
+        renderScene(0, 1, quad);
+    }
+
+    // Works through the tile queue for as long as the frame budget allows, one pass at a time, adding to accumulation
+    // texture `pingpong` in place. A pass that doesn't fit in a frame carries on in the next one, so no single frame
+    // blocks the GPU for long however expensive the view is
+    void renderCompute(const Window *window, bool pingpong)
+    {
+        initCompute();
+        if (computeRestart)
+        {
+            // Tiles around the cursor first, after the prepass when edge detection or the denoiser need iteration counts
+            tileScheduler.restart(resolution, glm::vec2(zoomOn_w));
+            computePrepass = (doEdgeDirectedSampling && doPixelSampling) || denoise.enabled;
+            computeRestart = false;
+        }
+        else if (tileScheduler.passDone())
+        {
+            // Without temporal anti aliasing the first pass is the final image
+            if (!computePrepass && !doTAA) return;
+            computePrepass = false;
+            tileScheduler.nextPass();
+        }
+
+        // The first pass overwrites whatever the previous view left behind
+        doTemporalAntiAliasing = renderedFrameCount > 0;
+
+        Shader &shader = computeShader();
+        shader.use();
+        setSettingsUniforms(shader, 0, 1);
+        shader.setBool("edgePrepass", computePrepass);
+
+        // Both textures are written as images, the iteration counts are also read through unit 1 for edge detection
+        glBindImageTexture(0, window->textures[pingpong], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+        glBindImageTexture(1, window->iterationTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, window->iterationTexture);
+        glActiveTexture(GL_TEXTURE0);
+
+        tileScheduler.dispatch(computeBudgetMs, [&](const Tile &tile)
+        {
+            shader.setVec2i("tileOrigin", tile.x, tile.y);
+            shader.setVec2i("tileEnd", tile.x + tile.width, tile.y + tile.height);
+            glDispatchCompute((tile.width + 7) / 8, (tile.height + 7) / 8, 1);
+        });
+
+        // Make the writes visible to the next pass' image loads and to the resolve pass
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+        if (!computePrepass && tileScheduler.passDone()) renderedFrameCount++;
+    }
+
+    // Resolves accumulation texture `pingpong` (and the iteration counts) into `window`'s 8-bit display texture
+    void resolveToDisplay(const Window *window, bool pingpong, FullQuad *quad)
+    {
+        // Bind the accumulated samples and the iteration counts for the resolve pass
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, window->iterationTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, window->textures[pingpong]);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, window->displayFBO);
+        glViewport(0, 0, window->width, window->height);
+        resolveScene(0, 1, quad);
+
+        // Unbind current FBO and textures
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void renderCpu(GLuint accumulationTexture, GLuint iterationTexture)
+    {
+        if (!cpuRenderer)
+        {
+            tileUploads = std::unique_ptr<PboRing>(new PboRing());
+            cpuRenderer = std::unique_ptr<CpuRenderer>(new CpuRenderer());
+            if (tileUploads->init()) cpuRenderer->setStaging(&tileUploads->tiles());
         }
+        updateView();
+        restartIfUpdated();
+
+        // Tiles around the cursor and the viewport centre get rendered first
+        cpuRenderer->setFocus({ glm::vec2(zoomOn_w), glm::vec2(resolution) / 2.0f });
+
+        if (cpuRestart)
+        {
+            Fractal::Params params = frameParams();
+            if (Fractal::tier(params) == Precision::PERTURBATION)
+            {
+                params.precision = Precision::PERTURBATION;
+                params.referenceOrbit = referenceOrbit(params);
+            }
+
+            // Deep views can't be snapped onto the cache's grid of doubles
+            bool cacheable = useTileCache && Fractal::tier(params) <= Precision::DOUBLE;
+            cpuRenderer->startCached(params, doTAA ? maxCpuPasses : 1, cacheable ? cacheAlignedView(params) : CacheView());
+            cpuRestart = false;
+        }
+
+        // Upload finished tiles straight into the textures the resolve pass reads. The workers wrote most of them into
+        // the upload ring already, only the ones that found it full come out of the CPU buffers
+        tileUploads->reclaim();
+        cpuRenderer->collectCompletedTiles([&](int slot, const Tile &tile, bool hasIterations)
+        {
+            tileUploads->upload(slot, tile, hasIterations, accumulationTexture, iterationTexture);
+        },
+        [&](const Tile &tile, const glm::vec4 *accumulation, const float *iterations)
+        {
+            int offset = tile.y*cpuRenderer->resolution().x + tile.x;
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, cpuRenderer->resolution().x);
+
+            glBindTexture(GL_TEXTURE_2D, accumulationTexture);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, tile.x, tile.y, tile.width, tile.height, GL_RGBA, GL_FLOAT, accumulation + offset);
+
+            glBindTexture(GL_TEXTURE_2D, iterationTexture);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, tile.x, tile.y, tile.width, tile.height, GL_RED, GL_FLOAT, iterations + offset);
+
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        });
+        tileUploads->fence();
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        renderedFrameCount = cpuRenderer->passesCompleted();
+    }
+
+    // Snaps `params` onto the tile cache's world grid, pixel sizes in steps of 2^(1/16) and the origin on a whole pixel
+    // Revisited views then line up with stored tiles, for a CPU image that is at most a pixel (and 2%) off the view
+    CacheView cacheAlignedView(Fractal::Params &params)
+    {
+        if (!tileCache) tileCache = std::unique_ptr<TileCache>(new TileCache(TileCache::defaultDirectory(), (size_t)tileCacheMemoryMB << 20, (size_t)tileCacheDiskMB << 20));
+
+        glm::dvec2 defaultPixel = defaultDimensions / 1024.0;
+        int level = (int)round(16.0*log2(defaultPixel.x*params.resolution.x / params.dimensions.x));
+        glm::dvec2 pixel = defaultPixel / pow(2.0, level / 16.0);
+        params.dimensions = pixel*(double)params.resolution.x;
+
+        // Same mapping as planeCoords, the origin is where pixel coordinate 0 lands
+        double aspect = params.resolution.y / (double)params.resolution.x;
+        CacheView view;
+        view.cache = tileCache.get();
+        view.originX = llround((params.centerCoords.x - params.dimensions.x/2.0) / pixel.x);
+        view.originY = llround((params.centerCoords.y - params.dimensions.y/2.0)*aspect / pixel.y);
+        params.centerCoords.x = view.originX*pixel.x + params.dimensions.x/2.0;
+        params.centerCoords.y = view.originY*pixel.y / aspect + params.dimensions.y/2.0;
+
+        // Everything else that changes a tile's pixels
+        uint64_t key = hashValue(params.type);
+        key = hashValue(params.maxIterations, key);
+        key = hashValue(params.lerpAlpha, key);
+        key = hashValue(level, key);
+        key = hashValue(params.doPixelSampling, key);
+        key = hashValue(params.samplingMethod, key);
+        key = hashValue(params.samplesPerPixel, key);
+        key = hashValue(params.test, key);
+        key = hashValue(params.doGammaCorrection, key);
+        key = hashValue(params.smoothColouring, key);
+        key = hashValue(params.gradientDegree, key);
+        key = hashValue(Fractal::tier(params), key);
+        for (const glm::vec3 &colour : params.gradient)
+        {
+            key = hashValue(colour.r, hashValue(colour.g, hashValue(colour.b, key)));
+        }
+        view.key = key;
+
+        return view;
+    }
+
+    bool showingIterationFile() const
+    {
+        return iterationFile != nullptr;
+    }
+
+    // Recolours the loaded iteration file into the textures the resolve pass reads, stretched to the viewport
+    void renderIterationFile(GLuint accumulationTexture, GLuint iterationTexture)
+    {
+        restartIfUpdated();
+        renderedFrameCount = 1;
+        if (!iterationFileDirty) return;
+
+        // Normally prepare() coloured it already, a file loaded after the snapshot waits for the next one
+        bool prepared = preparedFrame.updates == frameUpdates() && !preparedFrame.accumulation.empty();
+        if (!prepared && framePinned) return;
+        iterationFileDirty = false;
+        if (!prepared)
+        {
+            colourIterationFile(*iterationFile, frameParams(), preparedFrame.accumulation, preparedFrame.iterations);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, accumulationTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, resolution.x, resolution.y, GL_RGBA, GL_FLOAT, preparedFrame.accumulation.data());
+        glBindTexture(GL_TEXTURE_2D, iterationTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, resolution.x, resolution.y, GL_RED, GL_FLOAT, preparedFrame.iterations.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Colours `file` with `params`, stretched to `params.resolution`
+    static void colourIterationFile(const IterationFile::File &file, const Fractal::Params &params, std::vector<glm::vec4> &accumulation, std::vector<float> &iterations)
+    {
+        glm::ivec2 fileResolution = file.resolution();
+        glm::ivec2 resolution = params.resolution;
+        accumulation.resize((size_t)resolution.x*resolution.y);
+        iterations.resize(accumulation.size());
+
+        for (int y = 0; y < resolution.y; y++)
+        {
+            for (int x = 0; x < resolution.x; x++)
+            {
+                size_t index = (size_t)(y*fileResolution.y / resolution.y)*fileResolution.x + x*fileResolution.x / resolution.x;
+                glm::vec3 colour = file.colour(params, index);
+                if (params.doGammaCorrection) colour = Fractal::gammaCorrect(colour);
+
+                accumulation[(size_t)y*resolution.x + x] = glm::vec4(colour, 1.0f);
+                iterations[(size_t)y*resolution.x + x] = (float)file.iterations()[index];
+            }
+        }
+    }
+
+    // What the frames render, the snapshot given to renderFrom() or else the current settings
+    Fractal::Params frameParams() const
+    {
+        return framePinned ? frame.params : fractalParams();
+    }
+
+    uint64_t frameUpdates() const
+    {
+        return framePinned ? frame.updates : updates;
+    }
+
+    // Starts accumulating afresh whenever the settings the frames render change
+    void restartIfUpdated()
+    {
+        if (frameUpdates() == renderedUpdates) return;
+        renderedUpdates = frameUpdates();
+        renderedFrameCount = 0;
+        edgePrepassDone = false;
+        computeRestart = true;
+        cpuRestart = true;
+        iterationFileDirty = true;
+        settings.markDirty();
+    }
+
+    // The shader programs belong to the thread that renders, prepare() links them without the render thread's lock
+    // and the menus never touch them. Using them from another thread is a bug, caught here rather than as a data race
+    void claimPrograms()
+    {
+        if (programsThread == std::thread::id()) programsThread = std::this_thread::get_id();
+        if (programsThread == std::this_thread::get_id()) return;
+
+        std::cerr << "Error: Renderer's shader programs used from a thread other than the one rendering" << std::endl;
+        exit(1);
+    }
+
+    Fractal::Params fractalParams() const
+    {
+        Fractal::Params params;
+        params.type = (Fractal::Type)fractalType;
+        params.maxIterations = maxFractalIterations;
+        params.resolution = resolution;
+        params.centerCoords = centerCoords;
+        params.centerLow = centerLow;
+        params.precision = (Precision::Tier)precisionOverride;
+        params.dimensions = dimensions;
+        params.lerpAlpha = testDvec2;
+        params.doPixelSampling = doPixelSampling;
+        params.samplingMethod = samplingMethod;
+        params.samplesPerPixel = samplesPerPixel;
+        params.test = test;
+        params.doGammaCorrection = doGammaCorrection;
+        params.smoothColouring = smoothColouring;
+        params.gradientDegree = gradientDegree;
+        params.gradient = gradient;
+        return params;
+    }
+
+    void resolveScene(int accumulationTextureUnit, int iterationTextureUnit, FullQuad *quad)
+    {
+        // Read back the previous measurement once the GPU is done with it
+        if (resolveTimePending)
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(resolveTimeQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                GLuint64 elapsed;
+                glGetQueryObjectui64v(resolveTimeQuery, GL_QUERY_RESULT, &elapsed);
+                resolveTimeMs = elapsed / 1e6;
+                resolveTimePending = false;
+            }
+        }
+        if (!resolveTimePending) glBeginQuery(GL_TIME_ELAPSED, resolveTimeQuery);
+
+        resolveShader.use();
+        resolveShader.setInt("finalTexture", accumulationTextureUnit);
+        resolveShader.setInt("iterationTexture", iterationTextureUnit);
+        resolveShader.setBool("doDenoise", denoise.enabled);
+        resolveShader.setInt("denoiseRadius", denoise.radius);
+        resolveShader.setFloat("denoiseColourSigma", denoise.colourSigma);
+        resolveShader.setFloat("denoiseIterationSigma", denoise.iterationSigma);
+        resolveShader.setFloat("denoiseFadeFrames", denoise.fadeFrames);
+        resolveShader.setInt("renderedFrameCount", renderedFrameCount);
+        quad->render();
+
+        if (!resolveTimePending)
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            resolveTimePending = true;
+        }
+    }
+
+    void resetDefaultFractalValues()
+    {
+        Fractal::defaultView((Fractal::Type)fractalType, defaultCenter, defaultDimensions);
         
         dimensions = defaultDimensions;
         centerCoords = defaultCenter;
+        centerLow = glm::dvec2(0.0);
         zoomFactor = 1.0;
 
         onUpdate();
@@ -86,42 +564,136 @@ public:
         onUpdate();
     }
 
-    void setZoomOn(bool mouseInsideWindow, ImVec2 mousePos)
+    void setZoomOn(bool mouseInsideWindow, ImVec2 mousePosRelative)
     {
+        // Window coordinates of the point of interest, the viewport centre when the mouse is elsewhere
         zoomOn_w = mouseInsideWindow
-        ? glm::dvec2((double)mousePos.x, resolution.y - (double)mousePos.y)
-        : centerCoords;
+        ? glm::dvec2((double)mousePosRelative.x, resolution.y - (double)mousePosRelative.y)
+        : glm::dvec2(resolution) / 2.0;
     }
 
-    void setSettingsUniforms(GLint prevTextureUnit)
+    void updateView()
     {
-        // Recalculate some things first
-        doTemporalAntiAliasing = skipAA ? --skipAA > 1 : doTAA;
         dimensions = defaultDimensions / (double)zoomFactor;
         scale = glm::dvec2((double)resolution.x, (double)resolution.y) / dimensions;
+    }
 
-        shader.setBool("test", test);
-        shader.setBool("doPixelSampling", doPixelSampling);
-        shader.setBool("doGammaCorrection", doGammaCorrection);
-        shader.setBool("doTemporalAntiAliasing", doTemporalAntiAliasing);
+    // Arithmetic for the current view, picked from the pixel spacing unless overridden (same choice as the CPU engine's)
+    Precision::Tier precisionTier() const
+    {
+        Fractal::Params params;
+        params.resolution = resolution;
+        params.dimensions = defaultDimensions / (double)zoomFactor;
+        params.precision = (Precision::Tier)precisionOverride;
+        return Fractal::tier(params);
+    }
 
-        shader.setFloat("u_time", (float)glfwGetTime() / 1000.0f);
+    // Defines that specialize main.frag for `params`, with or without temporal anti aliasing
+    static std::string shaderDefines(const Fractal::Params &params, bool temporalAntiAliasing)
+    {
+        char defines[256];
+        snprintf(defines, sizeof(defines),
+            "#define FRACTAL_TYPE %d\n#define SAMPLING_METHOD %d\n#define TEMPORAL_AA %s\n#define SMOOTH_COLOURING %s\n#define TEST %s\n#define PRECISION_TIER %d\n",
+            (int)params.type, params.samplingMethod, temporalAntiAliasing ? "true" : "false", params.smoothColouring ? "true" : "false", params.test ? "true" : "false", (int)Fractal::tier(params));
+        return defines;
+    }
 
-        shader.setInt("renderedFrameCount", renderedFrameCount);
-        shader.setInt("samplingMethod", samplingMethod);
-        shader.setInt("samplesPerPixel", samplesPerPixel);
-        shader.setInt("prevFrameTexture", prevTextureUnit);
-        shader.setInt("fractalType", fractalType);
-        shader.setInt("maxFractalIterations", maxFractalIterations);
+    Shader &sceneShader()
+    {
+        if (!useShaderVariants) return sceneShaders.genericProgram();
 
-        shader.setVec2i("resolution", resolution);
+        // Anti aliasing gets skipped for a couple of frames after every update, so get both variants going
+        claimPrograms();
+        Fractal::Params params = frameParams();
+        sceneShaders.request(shaderDefines(params, !doTemporalAntiAliasing));
+        Shader &shader = sceneShaders.get(shaderDefines(params, doTemporalAntiAliasing));
+        shaderVariantCount = sceneShaders.variantCount();
+        shadersCompiling = sceneShaders.compilingCount();
+        return shader;
+    }
 
-        shader.setVec2d("dimensions", dimensions);
-        shader.setVec2d("centerCoords", centerCoords);
-        shader.setVec2d("testDvec2", testDvec2);
-        shader.setVec2d("scale", scale);
+    void initCompute()
+    {
+        if (computeShaders) return;
 
-        shader.setFloat("gradientDegree", gradientDegree);
+        // main.frag again, built as a compute shader
+        computeShaders = std::unique_ptr<ShaderVariants>(new ShaderVariants(ShaderVariants::compute("./src/shaders/main.frag", "#define COMPUTE_SHADER\n", programCache)));
+        tileScheduler.init();
+    }
+
+    Shader &computeShader()
+    {
+        if (!useShaderVariants) return computeShaders->genericProgram();
+
+        // The first pass goes without anti aliasing, the rest with it
+        claimPrograms();
+        Fractal::Params params = frameParams();
+        computeShaders->request(shaderDefines(params, !doTemporalAntiAliasing));
+        return computeShaders->get(shaderDefines(params, doTemporalAntiAliasing));
+    }
+
+    // The frame's reference orbit, as prepare() left it unless nothing was prepared for these settings
+    std::shared_ptr<const std::vector<glm::dvec2>> referenceOrbit(const Fractal::Params &params)
+    {
+        if (preparedFrame.updates == frameUpdates() && preparedFrame.referenceOrbit) return preparedFrame.referenceOrbit;
+        return std::make_shared<const std::vector<glm::dvec2>>(Fractal::referenceOrbit(params));
+    }
+
+    void setSettingsUniforms(Shader &shader, GLint prevTextureUnit, GLint iterationTextureUnit)
+    {
+        // Recalculate some things first
+        updateView();
+
+        // Settings only change through onUpdate(), so most frames skip the upload
+        if (settings.isDirty())
+        {
+            Fractal::Params params = frameParams();
+            SettingsBlock &block = settings.data;
+            block.centerCoords = params.centerCoords;
+            block.dimensions = params.dimensions;
+            block.scale = glm::dvec2(params.resolution) / params.dimensions;
+            block.testDvec2 = params.lerpAlpha;
+            block.resolution = params.resolution;
+
+            // Deep tiers start from the double-double view centre, perturbation from its orbit
+            DoubleDouble planeX, planeY;
+            Fractal::planeCenter(params, planeX, planeY);
+            block.planeCenterX = glm::dvec2(planeX.hi, planeX.lo);
+            block.planeCenterY = glm::dvec2(planeY.hi, planeY.lo);
+            block.precisionTier = Fractal::tier(params);
+            block.referenceLength = 0;
+            if (block.precisionTier == Precision::PERTURBATION)
+            {
+                std::shared_ptr<const std::vector<glm::dvec2>> orbit = referenceOrbit(params);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, referenceBuffer);
+                glBufferData(GL_SHADER_STORAGE_BUFFER, orbit->size()*sizeof(glm::dvec2), orbit->data(), GL_STATIC_DRAW);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+                block.referenceLength = (GLint)orbit->size();
+            }
+
+            block.samplingMethod = params.samplingMethod;
+            block.samplesPerPixel = params.samplesPerPixel;
+            block.edgeThreshold = edgeThreshold;
+            block.fractalType = params.type;
+            block.maxFractalIterations = params.maxIterations;
+            block.gradientSize = (GLint)std::min(params.gradient.size(), (size_t)MAX_GRADIENT_SIZE);
+            block.gradientDegree = params.gradientDegree;
+
+            block.test = params.test;
+            block.doGammaCorrection = params.doGammaCorrection;
+            block.doPixelSampling = params.doPixelSampling;
+            block.doEdgeDirectedSampling = doEdgeDirectedSampling;
+            block.smoothColouring = params.smoothColouring;
+
+            for (int i = 0; i < block.gradientSize; i++) block.gradient[i] = glm::vec4(params.gradient[i], 0.0f);
+        }
+        settings.upload();
+
+        // What changes from frame to frame stays a plain uniform
+        shader.setBool("doTemporalAntiAliasing", doTemporalAntiAliasing);
+        shader.setInt("renderedFrameCount", renderedFrameCount);
+        shader.setInt("prevFrameTexture", prevTextureUnit);
+        shader.setInt("iterationTexture", iterationTextureUnit);
     }
 
 
@@ -131,17 +703,57 @@ public:
     {
         ImGui::Text("%.4f FPS", ImGui::GetIO().Framerate);
         ImGui::Text("%d Frames sampled", renderedFrameCount);
+        if (useCpuEngine && cpuRenderer) ImGui::Text("CPU engine: %d threads", cpuRenderer->threadCount());
+        if (showingIterationFile()) ImGui::Text("Iteration file: %dx%d", iterationFile->resolution().x, iterationFile->resolution().y);
+        if (useCpuEngine && tileCache)
+        {
+            TileCache::Stats stats = tileCache->statistics();
+            double lookups = std::max(1.0, (double)(stats.memoryHits + stats.diskHits + stats.misses));
+            ImGui::Text("Tile cache hits: %.1f%% memory, %.1f%% disk", 100.0*stats.memoryHits / lookups, 100.0*stats.diskHits / lookups);
+            ImGui::Text("Tile cache: %d tiles (%.1f MB) in memory, %d (%.1f MB) on disk", stats.memoryTiles, stats.memoryBytes / 1048576.0, stats.diskTiles, stats.diskBytes / 1048576.0);
+        }
+        Precision::Tier tier = precisionTier();
+        ImGui::Text("Precision: %s (%s, pixel spacing %.3g)", Precision::name(tier), precisionOverride == Precision::AUTO ? "auto" : "forced", std::max(dimensions.x, dimensions.y) / resolution.x);
         SHOW_VEC2I("Resolution", resolution);
         SHOW_VEC2D("Scale", scale);
         SHOW_VEC2D("Dimensions", dimensions);
         SHOW_VEC2D("Zoom on", zoomOn_w);
+        ImGui::Text("Resolve%s: %.3f ms", denoise.enabled ? " + denoise" : "", resolveTimeMs);
+        ImGui::Text("Settings block uploads: %d", settings.uploadCount());
+        if (useShaderVariants) ImGui::Text("Shader variants: %d (%d compiling)", shaderVariantCount, shadersCompiling);
+        if (useComputeShader && !useCpuEngine)
+        {
+            ImGui::Text("%s: %d/%d tiles, %d this frame", computePrepass ? "Prepass" : "Pass", tileScheduler.tilesDone(), tileScheduler.tileCount(), tileScheduler.lastFrameTiles());
+            ImGui::Text("Tile time: %.3f ms", tileScheduler.msPerTile());
+        }
     }
 
     void renderingMenu()
     {
         bool updated = false;
 
+        // Pick the engine rendering the viewport
+        if (ImGui::RadioButton("GPU", !useCpuEngine)) { useCpuEngine = false; updated = true; }
+        ImGui::SameLine();
+        if (ImGui::RadioButton("CPU", useCpuEngine)) { useCpuEngine = true; updated = true; }
+
+        // Renders in tiles, only as many per frame as fit in the budget
+        if (!useCpuEngine)
+        {
+            updated |= ImGui::Checkbox("Compute Shader Tiles", &useComputeShader);
+            if (useComputeShader) ImGui::SliderFloat("Frame budget (ms)", &computeBudgetMs, 1.0f, 50.0f, "%.1f");
+        }
+
         updated |= ImGui::Checkbox("Test", &test);
+        ImGui::Checkbox("Specialized Shaders", &useShaderVariants);
+
+        // Auto picks the cheapest arithmetic that still resolves the pixels
+        int precisionItem = precisionOverride + 1;
+        if (ImGui::Combo("Precision", &precisionItem, "Auto\0Float\0Double\0Double-double\0Perturbation\0Quad-double (CPU)\0Fixed-point (CPU)\0"))
+        {
+            precisionOverride = precisionItem - 1;
+            updated = true;
+        }
         
         updated |= ImGui::Checkbox("Gamma Correction", &doGammaCorrection);
         updated |= ImGui::Checkbox("Temporal Anti-Aliasing", &doTAA);
@@ -178,6 +790,35 @@ public:
 
             // Set number of pixel samples
             updated |= ImGui::SliderInt("Samples per pixel", &(samplesPerPixel), 1, 20, samplingMethod == 1 ? "%d^2" : "%d");
+
+            // Only supersample pixels whose neighbourhood has differing iteration counts
+            updated |= ImGui::Checkbox("Edge-directed sampling", &doEdgeDirectedSampling);
+            if (doEdgeDirectedSampling)
+            {
+                updated |= ImGui::SliderInt("Edge threshold", &edgeThreshold, 0, 10);
+            }
+        }
+
+        // Finished CPU tiles are kept around for revisits
+        if (useCpuEngine)
+        {
+            ImGui::SeparatorText("Tile cache");
+            updated |= ImGui::Checkbox("Cache tiles", &useTileCache);
+            bool budgets = ImGui::SliderInt("Memory budget (MB)", &tileCacheMemoryMB, 16, 4096);
+            budgets |= ImGui::SliderInt("Disk budget (MB)", &tileCacheDiskMB, 0, 16384);
+            if (budgets && tileCache) tileCache->setBudgets((size_t)tileCacheMemoryMB << 20, (size_t)tileCacheDiskMB << 20);
+            if (tileCache && ImGui::Button("Clear cache")) tileCache->clear();
+        }
+
+        // Edge-aware denoiser, stands in for accumulated frames in the preview
+        ImGui::SeparatorText("Denoiser");
+        updated |= ImGui::Checkbox("Denoise", &denoise.enabled);
+        if (denoise.enabled)
+        {
+            ImGui::SliderInt("Radius", &denoise.radius, 1, 6);
+            ImGui::DragFloat("Colour sigma", &denoise.colourSigma, 0.01, 0.01, 2.0, "%.3f");
+            ImGui::DragFloat("Iteration sigma", &denoise.iterationSigma, 0.05, 0.05, 20.0, "%.3f");
+            ImGui::DragFloat("Fade out frames", &denoise.fadeFrames, 1.0, 1.0, 4096.0, "%.0f");
         }
 
         if (updated) onUpdate();
@@ -197,13 +838,96 @@ public:
 
         reset |= ImGui::Button("Reset");
 
-        updated |= ImGui::DragDouble2("Center coordinates", &centerCoords.x, 0.1 / (zoomFactor*100.0), 0.0, 0.0, "%.6f");
-        updated |= ImGui::DragDouble("Zoom Factor", &zoomFactor, 1.0 + (zoomFactor/1000.0), 0.5, 1000000.0);
+        if (ImGui::DragDouble2("Center coordinates", &centerCoords.x, 0.1 / (zoomFactor*100.0), 0.0, 0.0, "%.6f"))
+        {
+            // Typed or dragged coordinates replace the low halves too
+            centerLow = glm::dvec2(0.0);
+            updated = true;
+        }
+        updated |= ImGui::DragDouble("Zoom Factor", &zoomFactor, 1.0 + (zoomFactor/1000.0), 0.5, 1e300, "%.6g");
         updated |= ImGui::DragInt("Max iterations", &maxFractalIterations, 1, 1, 10000);
 
         updated |= reset;
         if (reset) resetDefaultFractalValues();
-        if (updated) onUpdate();
+        if (updated)
+        {
+            iterationFile.reset();
+            onUpdate();
+        }
+
+        // Stored escape data, shown instead of rendering until the view changes
+        ImGui::SeparatorText("Iteration file");
+        ImGui::InputText("Path", iterationFilePath, sizeof(iterationFilePath));
+        if (ImGui::Button("Load")) loadIterationFile();
+        if (showingIterationFile())
+        {
+            ImGui::SameLine();
+            if (ImGui::Button("Close"))
+            {
+                iterationFile.reset();
+                onUpdate();
+            }
+        }
+    }
+
+    void loadIterationFile()
+    {
+        std::shared_ptr<IterationFile::File> file = std::make_shared<IterationFile::File>();
+        if (!file->open(iterationFilePath)) return;
+        iterationFile = file;
+
+        // Take over the file's view so dragging and zooming carry on from it
+        Fractal::Params params;
+        iterationFile->viewParams(params);
+        setView(params);
+        precisionOverride = params.precision;
+    }
+
+    // Takes over the view of `params`
+    void setView(const Fractal::Params &params)
+    {
+        fractalType = (FractalType)params.type;
+        resetDefaultFractalValues();
+        maxFractalIterations = params.maxIterations;
+        centerCoords = params.centerCoords;
+        centerLow = params.centerLow;
+        zoomFactor = defaultDimensions.x / params.dimensions.x;
+        testDvec2 = params.lerpAlpha;
+
+        onUpdate();
+    }
+
+    // Takes over a whole parameter set for rendering without the GUI, every GPU frame adds a pass of samples
+    // Unlike interactive use the first frames aren't rendered without anti aliasing, so no samples are thrown away
+    void setParams(const Fractal::Params &params, const Denoise::Settings &denoiseSettings, bool computeTiles = false)
+    {
+        setView(params);
+        doPixelSampling = params.doPixelSampling;
+        samplingMethod = params.samplingMethod;
+        samplesPerPixel = params.samplesPerPixel;
+        test = params.test;
+        doGammaCorrection = params.doGammaCorrection;
+        smoothColouring = params.smoothColouring;
+        gradientDegree = params.gradientDegree;
+        gradient = params.gradient;
+        precisionOverride = params.precision;
+        denoise = denoiseSettings;
+
+        doTAA = true;
+        useCpuEngine = false;
+        useComputeShader = computeTiles;
+        skipAA = 0;
+    }
+
+    // The GPU batch renderer gives tiles the whole frame, it has nothing else to keep responsive
+    void setComputeBudget(float budgetMs)
+    {
+        computeBudgetMs = budgetMs;
+    }
+
+    int framesSampled() const
+    {
+        return renderedFrameCount;
     }
 
     void colourMenu()
@@ -273,27 +997,74 @@ public:
     void mouseDragCallback(ImVec2 dpos)
     {
         // Update center coordinates based on the scale of the image, and the mouse drag distance
-        centerCoords -= glm::dvec2((double)dpos.x, -(double)dpos.y) / scale;
+        // At double-double precision, deep in a zoom a drag moves the centre by less than a double can add
+        glm::dvec2 offset = -glm::dvec2((double)dpos.x, -(double)dpos.y) / scale;
+        DoubleDouble x = DD::add(DoubleDouble(centerCoords.x, centerLow.x), offset.x);
+        DoubleDouble y = DD::add(DoubleDouble(centerCoords.y, centerLow.y), offset.y);
+        centerCoords = glm::dvec2(x.hi, y.hi);
+        centerLow = glm::dvec2(x.lo, y.lo);
+        iterationFile.reset();
         onUpdate();
     }
 
     void mouseScrollCallback(float yOffset)
     {
         zoomFactor *= 1.0 + yOffset*0.3;
+        iterationFile.reset();
         onUpdate();
     }
 
 private:
 
-    Shader shader;
+    ProgramCache *programCache = nullptr;
+    ShaderVariants sceneShaders;
+    Shader resolveShader;
+
+    // Mirrors the std140 `Settings` block in main.frag: bools take 4 bytes and array elements are padded to a vec4
+    static constexpr int MAX_GRADIENT_SIZE = 10;
+    static constexpr GLuint SETTINGS_BINDING = 0;
+    static constexpr GLuint REFERENCE_BINDING = 1;
+    struct SettingsBlock
+    {
+        glm::dvec2 centerCoords;
+        glm::dvec2 dimensions;
+        glm::dvec2 scale;
+        glm::dvec2 testDvec2;
+        glm::dvec2 planeCenterX;
+        glm::dvec2 planeCenterY;
+        glm::ivec2 resolution;
+
+        GLint samplingMethod;
+        GLint samplesPerPixel;
+        GLint edgeThreshold;
+        GLint fractalType;
+        GLint maxFractalIterations;
+        GLint gradientSize;
+        GLfloat gradientDegree;
+        GLint precisionTier;
+        GLint referenceLength;
+
+        GLint test;
+        GLint doGammaCorrection;
+        GLint doPixelSampling;
+        GLint doEdgeDirectedSampling;
+        GLint smoothColouring;
+
+        glm::vec4 gradient[MAX_GRADIENT_SIZE];
+    };
+    static_assert(offsetof(SettingsBlock, resolution) == 96 && offsetof(SettingsBlock, test) == 140, "SettingsBlock no longer matches std140");
+    static_assert(offsetof(SettingsBlock, gradient) == 160 && sizeof(SettingsBlock) == 320, "SettingsBlock no longer matches std140");
+    UniformBuffer<SettingsBlock> settings;
+    GLuint referenceBuffer = 0;
     
     // States
     int skipAA = 0;
     bool doTemporalAntiAliasing = true;
     bool doTAA = true;
+    bool useShaderVariants = true;
+    int shaderVariantCount = 0, shadersCompiling = 0;  // For dataGui(), which can't look while prepare() links
 
     // Renderer settings
-    float u_time;
     double zoomFactor = 1.0;
     int renderedFrameCount = 0;
     int samplingMethod = 0;
@@ -301,6 +1072,45 @@ private:
     bool test = false;
     bool doGammaCorrection = false;
     bool doPixelSampling = true;
+    bool doEdgeDirectedSampling = false;
+    bool edgePrepassDone = false;
+    int edgeThreshold = 0;
+
+    // Compute shader tiles, compiled the first time they are selected
+    bool useComputeShader = false;
+    bool computeRestart = true;
+    bool computePrepass = false;
+    float computeBudgetMs = 8.0f;
+    std::unique_ptr<ShaderVariants> computeShaders;
+    TileScheduler tileScheduler;
+
+    // CPU engine, created the first time it is selected
+    bool useCpuEngine = false;
+    bool cpuRestart = true;
+    int maxCpuPasses = 1024;
+
+    // Tile cache for the CPU engine, created on first use (declared first so it outlives the engine's workers)
+    bool useTileCache = false;
+    int tileCacheMemoryMB = 256;
+    int tileCacheDiskMB = 1024;
+    std::unique_ptr<TileCache> tileCache;
+
+    // Mapped buffer the engine's workers write finished tiles into, declared first for the same reason
+    std::unique_ptr<PboRing> tileUploads;
+
+    std::unique_ptr<CpuRenderer> cpuRenderer;
+
+    // Loaded iteration file, recoloured whenever the settings change. Shared with the snapshot being prepared, which
+    // keeps it mapped if it's closed meanwhile
+    std::shared_ptr<IterationFile::File> iterationFile;
+    char iterationFilePath[256] = "fractal.iter";
+    bool iterationFileDirty = false;
+
+    // Denoiser and resolve timing
+    Denoise::Settings denoise;
+    GLuint resolveTimeQuery;
+    bool resolveTimePending = false;
+    double resolveTimeMs = 0.0;
 
     // Fractal settings
     enum FractalType { MANDELBROT, JULIA, LERP } fractalType = MANDELBROT;
@@ -313,12 +1123,29 @@ private:
 
     glm::dvec2 defaultCenter;
     glm::dvec2 centerCoords;
+    glm::dvec2 centerLow = glm::dvec2(0.0);   // Low halves of the centre as double-doubles
+    int precisionOverride = Precision::AUTO;
     
     glm::dvec2 defaultDimensions;
     glm::dvec2 dimensions;
 
     glm::dvec2 testDvec2 = glm::dvec2(0.0);
 
+    // Bumped by onUpdate(), the version the frames last restarted for, the snapshot they render and what prepare() made
+    // of it (render thread only)
+    uint64_t updates = 0;
+    uint64_t renderedUpdates = ~(uint64_t)0;
+    Snapshot frame;
+    bool framePinned = false;
+    std::thread::id programsThread;
+    struct PreparedFrame
+    {
+        uint64_t updates = ~(uint64_t)0;
+        std::shared_ptr<const std::vector<glm::dvec2>> referenceOrbit;
+        std::vector<glm::vec4> accumulation;
+        std::vector<float> iterations;
+    } preparedFrame;
+
     // * Gradient implementation
     std::vector<glm::vec3> gradient;
     int maxGradientSize = 10;
@@ -328,19 +1155,7 @@ private:
     void initGradient()
     {
         // Initial gradient
-        gradient.push_back(glm::vec3(0.0, 0.0, 0.0));
-        gradient.push_back(glm::vec3(1.0, 0.0, 0.0));
-        gradient.push_back(glm::vec3(1.0, 1.0, 0.0));
-        gradient.push_back(glm::vec3(1.0, 1.0, 1.0));
-    }
-
-    void setGradientUniforms()
-    {
-        GLint location = glGetUniformLocation(shader.ID, "gradient");
-        glUniform3fv(location, gradient.size(), &gradient[0][0]);
-
-        shader.setInt("gradientSize", gradient.size());
-        shader.setBool("smoothColouring", smoothColouring);
+        gradient = Fractal::defaultGradient();
     }
 
 };
@@ -0,0 +1,42 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+// CPU mirror of the low discrepancy sampling in main.frag, keep both in sync
+namespace Sampling
+{
+    // R2 sequence increments (1/g, 1/g^2 with g the plastic constant) as 0.32 fixed point
+    const uint32_t R2_ALPHA_X = 0xC13FA9A9u;
+    const uint32_t R2_ALPHA_Y = 0x91E10DA6u;
+
+    inline uint32_t hash(uint32_t x)
+    {
+        // Integer avalanche hash (lowbias32)
+        x ^= x >> 16;
+        x *= 0x7FEB352Du;
+        x ^= x >> 15;
+        x *= 0x846CA68Bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    inline glm::uvec2 pixelScramble(int x, int y, uint32_t stream)
+    {
+        // Per-pixel (and per-stream) random rotation so neighbouring pixels don't share sample positions
+        uint32_t h = hash((uint32_t)x ^ hash((uint32_t)y ^ hash(stream)));
+        return glm::uvec2(h, hash(h));
+    }
+
+    inline glm::vec2 r2Sample(int x, int y, uint32_t index, uint32_t stream)
+    {
+        // Cranley-Patterson rotated R2 point in [0, 1)^2, computed in fixed point so it is exact and reproducible
+        glm::uvec2 scramble = pixelScramble(x, y, stream);
+        uint32_t px = index * R2_ALPHA_X + scramble.x;
+        uint32_t py = index * R2_ALPHA_Y + scramble.y;
+        return glm::vec2((float)(px >> 8), (float)(py >> 8)) / 16777216.0f;
+    }
+}
+
+#endif
@@ -2,12 +2,26 @@
 #define SHADER_H
 
 #include <glad/glad.h>
+#include <string.h>
 #include <string>
+#include <unordered_map>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "programCache.h"
+
+// Shader sources compiled into the binary by the embedShaders build step, read from disk when it hasn't run
+#if __has_include("embeddedShaders.h")
+#include "embeddedShaders.h"
+#define HAS_EMBEDDED_SHADERS
+#endif
+
+#ifndef GL_COMPLETION_STATUS_ARB
+#define GL_COMPLETION_STATUS_ARB 0x91B1
+#endif
+typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
 
 class Shader
 {
@@ -18,95 +32,177 @@ public:
 
     Shader() {}
 
-    Shader(const char *vertexPath, const char *fragmentPath)
+    Shader(const char *vertexPath, const char *fragmentPath, const std::string &defines = "", ProgramCache *cache = nullptr)
     {
-        // Retrieve the vertex and fragment shader code from filepaths
-        std::string vertexCode, fragmentCode;
-        std::ifstream vShaderFile, fShaderFile;
+        *this = compile(source(vertexPath), source(fragmentPath), defines, cache);
+        finishLinking();
+    }
 
-        // Ensure ifstream objects can throw exceptions
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try
+    // Starts compiling and linking without waiting for the driver, call `finishLinking()` before using the program
+    // `defines` go right after the `#version` line, so one source can be built into specialized variants
+    // With a `cache` the linked binary is loaded from (or, once linked, saved to) disk instead
+    static Shader compile(const std::string &vertexCode, const std::string &fragmentCode, const std::string &defines = "", ProgramCache *cache = nullptr)
+    {
+        Shader shader;
+        std::string specializedCode = insertDefines(fragmentCode, defines);
+
+        // Create shader Program
+        shader.ID = glCreateProgram();
+        if (cache)
         {
-            // Open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-
-            // Read file contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-
-            // Close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-
-            // Convert code into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
+            shader.binaryCache = cache;
+            shader.binaryKey = cache->key(vertexCode, specializedCode);
+            if (cache->load(shader.binaryKey, shader.ID))
+            {
+                shader.linked = true;
+                shader.cacheLocations();
+                return shader;
+            }
+            glProgramParameteri(shader.ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         }
-        catch (std::ifstream::failure e)
+
+        shader.vertex = compileStage(GL_VERTEX_SHADER, vertexCode);
+        shader.fragment = compileStage(GL_FRAGMENT_SHADER, specializedCode);
+        glAttachShader(shader.ID, shader.vertex);
+        glAttachShader(shader.ID, shader.fragment);
+        glLinkProgram(shader.ID);
+
+        return shader;
+    }
+
+    // Same as `compile()` for a compute program, built from a single stage
+    static Shader compileCompute(const std::string &computeCode, const std::string &defines = "", ProgramCache *cache = nullptr)
+    {
+        Shader shader;
+        std::string specializedCode = insertDefines(computeCode, defines);
+
+        shader.ID = glCreateProgram();
+        if (cache)
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+            shader.binaryCache = cache;
+            shader.binaryKey = cache->key("", specializedCode);
+            if (cache->load(shader.binaryKey, shader.ID))
+            {
+                shader.linked = true;
+                shader.cacheLocations();
+                return shader;
+            }
+            glProgramParameteri(shader.ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         }
-        const char *vShaderCode = vertexCode.c_str();
-        const char *fShaderCode = fragmentCode.c_str();
 
-        // Compile vertex shader
-        GLuint vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
+        shader.compute = compileStage(GL_COMPUTE_SHADER, specializedCode);
+        glAttachShader(shader.ID, shader.compute);
+        glLinkProgram(shader.ID);
+
+        return shader;
+    }
+
+    // Lets the driver compile on as many background threads as it likes, call once per context after loading GL
+    // Without GL_ARB/KHR_parallel_shader_compile `compile()` still returns at once, but the driver does the work when
+    // the program is first queried, so `finishLinking()` blocks the calling thread for the whole compile
+    static void enableParallelCompile(GLADloadproc load)
+    {
+        if (!parallelCompileSupported()) return;
+
+        MaxShaderCompilerThreadsProc maxThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsKHR");
+        if (!maxThreads) maxThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsARB");
+        if (maxThreads) maxThreads(0xFFFFFFFF);
+    }
+
+    // Whether `finishLinking()` would return without stalling (always true without parallel shader compilation)
+    bool compiled() const
+    {
+        if (linked) return true;
+        if (!parallelCompileSupported()) return true;
+
+        GLint done = GL_FALSE;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_ARB, &done);
+        return done == GL_TRUE;
+    }
+
+    bool isLinked() const
+    {
+        return linked;
+    }
 
-        // Check for vertex shader compilation errors
+    void finishLinking()
+    {
+        if (linked) return;
+
+        // Check for compilation errors
+        checkStage(vertex, "VERTEX_SHADER");
+        checkStage(fragment, "FRAGMENT_SHADER");
+        checkStage(compute, "COMPUTE_SHADER");
+
+        // Check for linking errors
         GLint success;
         char infoLog[512];
-        glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
         if (!success)
         {
-            glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-            std::cerr << "ERROR::VERTEX_SHADER::COMPILATION_FAILED\n" << infoLog << std::endl;
+            glGetProgramInfoLog(ID, 512, NULL, infoLog);
+            std::cerr << "ERROR::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
             exit(1);
         }
 
-        // Compile fragment shader
-        GLuint fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
+        // Cleanup
+        for (GLuint stage : { vertex, fragment, compute }) if (stage) glDeleteShader(stage);
+        vertex = fragment = compute = 0;
+        linked = true;
+
+        if (binaryCache) binaryCache->store(binaryKey, ID);
+        cacheLocations();
+    }
 
-        // Check for vertex shader compilation errors
-        glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-        if (!success)
+    // Embedded copy of the shader at `path` if there is one, otherwise the file
+    static std::string source(const char *path)
+    {
+#ifdef HAS_EMBEDDED_SHADERS
+        if (strncmp(path, "./", 2) == 0) path += 2;
+        for (const EmbeddedShader &shader : embeddedShaders)
         {
-            glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-            std::cerr << "ERROR::FRAGMENT_SHADER::COMPILATION_FAILED\n" << infoLog << std::endl;
-            exit(1);
+            if (strcmp(shader.path, path) == 0) return shader.source;
         }
+#endif
+        return readFile(path);
+    }
 
-        // Create shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
+    static std::string readFile(const char *path)
+    {
+        std::ifstream file;
+        std::stringstream stream;
 
-        // Check for linking errors
-        glGetProgramiv(ID, GL_LINK_STATUS, &success);
-        if (!success)
+        // Ensure ifstream objects can throw exceptions
+        file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        try
         {
-            glGetProgramInfoLog(ID, 512, NULL, infoLog);
-            std::cerr << "ERROR::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-            exit(1);
+            file.open(path);
+            stream << file.rdbuf();
+            file.close();
+        }
+        catch (std::ifstream::failure &e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
 
-        // Cleanup
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+        return stream.str();
     }
 
     void use()
     {
         glUseProgram(ID);
     }
+
+    // Size the linker gave a uniform block, -1 if the program has no such block
+    GLint uniformBlockSize(const char *name) const
+    {
+        GLuint index = glGetUniformBlockIndex(ID, name);
+        if (index == GL_INVALID_INDEX) return -1;
+
+        GLint size;
+        glGetActiveUniformBlockiv(ID, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+        return size;
+    }
     
 
     // * FLOAT * //
@@ -232,9 +328,88 @@ public:
 
 private:
 
+    GLuint vertex = 0, fragment = 0, compute = 0;
+    bool linked = false;
+    ProgramCache *binaryCache = nullptr;
+    uint64_t binaryKey = 0;
+
+    static GLuint compileStage(GLenum type, const std::string &code)
+    {
+        const char *source = code.c_str();
+        GLuint stage = glCreateShader(type);
+        glShaderSource(stage, 1, &source, NULL);
+        glCompileShader(stage);
+        return stage;
+    }
+
+    static void checkStage(GLuint stage, const char *name)
+    {
+        if (!stage) return;
+
+        GLint success;
+        glGetShaderiv(stage, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            char infoLog[512];
+            glGetShaderInfoLog(stage, 512, NULL, infoLog);
+            std::cerr << "ERROR::" << name << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+            exit(1);
+        }
+    }
+
+    static std::string insertDefines(const std::string &code, const std::string &defines)
+    {
+        if (defines.empty()) return code;
+
+        // `#line` keeps compiler messages pointing at the lines of the file on disk
+        size_t version = code.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+        if (lineEnd == std::string::npos) return defines + code;
+        return code.substr(0, lineEnd + 1) + defines + "#line 2\n" + code.substr(lineEnd + 1);
+    }
+
+    static bool parallelCompileSupported()
+    {
+        static int supported = -1;
+        if (supported == -1)
+        {
+            supported = 0;
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for (GLint i = 0; i < count; i++)
+            {
+                const char *name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+                if (strcmp(name, "GL_ARB_parallel_shader_compile") == 0 || strcmp(name, "GL_KHR_parallel_shader_compile") == 0) supported = 1;
+            }
+        }
+        return supported == 1;
+    }
+
+    // Locations of the active uniforms outside blocks, looked up once after linking
+    std::unordered_map<std::string, GLint> locations;
+
+    void cacheLocations()
+    {
+        GLint count = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            char name[256];
+            glGetActiveUniformName(ID, i, sizeof(name), nullptr, name);
+            GLint location = glGetUniformLocation(ID, name);
+            if (location == -1) continue;
+
+            // Arrays are listed as `name[0]`, set through their plain name
+            std::string key = name;
+            if (key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0) key.resize(key.size() - 3);
+            locations[key] = location;
+        }
+    }
+
     GLint getLocation(const std::string &name) const
     {
-        GLint location = glGetUniformLocation(ID, name.c_str());
+        auto found = locations.find(name);
+        GLint location = found != locations.end() ? found->second : -1;
 
         if (location == -1 && validateUniform)
         {
@@ -0,0 +1,115 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <string>
+#include <unordered_map>
+#include "shader.h"
+
+// Programs built from one shader source with different sets of `#define`s, compiled on first request and kept
+// While a variant is still compiling the generic program (no defines, runtime branches) stands in for it, so
+// switching settings never waits on the driver
+class ShaderVariants
+{
+public:
+
+    ShaderVariants() {}
+
+    ShaderVariants(const char *vertexPath, const char *fragmentPath, ProgramCache *programCache = nullptr)
+        : vertexCode(Shader::source(vertexPath)), code(Shader::source(fragmentPath)), cache(programCache)
+    {
+        generic = build("");
+        generic.finishLinking();
+    }
+
+    // Compute programs from `computePath`, every variant (the generic one too) also gets `commonDefines`
+    static ShaderVariants compute(const char *computePath, const std::string &commonDefines, ProgramCache *programCache = nullptr)
+    {
+        ShaderVariants variants;
+        variants.code = Shader::source(computePath);
+        variants.baseDefines = commonDefines;
+        variants.cache = programCache;
+        variants.generic = variants.build("");
+        variants.generic.finishLinking();
+        return variants;
+    }
+
+    Shader &genericProgram()
+    {
+        return generic;
+    }
+
+    // Starts compiling a variant ahead of time, false if it was already known
+    bool request(const std::string &defines)
+    {
+        if (defines.empty() || variants.count(defines)) return false;
+
+        // Programs loaded from the binary cache come back linked, there's nothing to wait for
+        variants[defines] = build(defines);
+        if (!variants[defines].isLinked()) compiling++;
+        return true;
+    }
+
+    // The variant for `defines` if it's ready, otherwise the generic program
+    // A new variant always gets at least a frame, a head start for drivers that compile in the background
+    Shader &get(const std::string &defines)
+    {
+        if (request(defines) || defines.empty()) return generic;
+
+        Shader &variant = variants[defines];
+        if (!variant.compiled()) return generic;
+        if (!variant.isLinked())
+        {
+            variant.finishLinking();
+            compiling--;
+        }
+        return variant;
+    }
+
+    // Links the variant for `defines` if that doesn't mean waiting on a background compile, so a later get() finds it
+    // ready. Without parallel compilation the driver compiles the whole program right here
+    void link(const std::string &defines)
+    {
+        if (defines.empty()) return;
+
+        request(defines);
+        Shader &variant = variants[defines];
+        if (variant.isLinked() || !variant.compiled()) return;
+        variant.finishLinking();
+        compiling--;
+    }
+
+    // The variant for `defines`, waiting for it to finish compiling if need be
+    Shader &ready(const std::string &defines)
+    {
+        if (defines.empty()) return generic;
+
+        request(defines);
+        Shader &variant = variants[defines];
+        if (!variant.isLinked())
+        {
+            variant.finishLinking();
+            compiling--;
+        }
+        return variant;
+    }
+
+    int variantCount() const { return (int)variants.size(); }
+    int compilingCount() const { return compiling; }
+
+private:
+
+    std::string vertexCode, code;  // No vertex stage for compute programs
+    std::string baseDefines;
+    ProgramCache *cache = nullptr;
+    Shader generic;
+    std::unordered_map<std::string, Shader> variants;
+    int compiling = 0;
+
+    Shader build(const std::string &defines) const
+    {
+        if (vertexCode.empty()) return Shader::compileCompute(code, baseDefines + defines, cache);
+        return Shader::compile(vertexCode, code, baseDefines + defines, cache);
+    }
+};
+
+#endif
@@ -1,8 +1,23 @@
-#version 460 core
+#version 450 core
 
 // * Inputs / Outputs
+#ifdef COMPUTE_SHADER
+// Built as a compute shader too (see `Renderer::renderCompute()`), each dispatch covers one tile and adds to the
+// accumulation image in place
+layout(local_size_x = 8, local_size_y = 8) in;
+layout(rgba32f, binding = 0) uniform image2D accumulationImage;
+layout(r32f, binding = 1) uniform image2D iterationImage;
+uniform ivec2 tileOrigin;
+uniform ivec2 tileEnd;
+
+// Stands in for gl_FragCoord, the pixel's window coordinates
+vec2 fragCoord;
+#define FRAG_COORD fragCoord
+#else
 in vec2 TexCoords;
 out vec4 FragColour;
+#define FRAG_COORD gl_FragCoord.xy
+#endif
 
 // * Macrodefinitions
 #define FLOAT_MAX 3.402823466e+38
@@ -11,35 +26,70 @@ out vec4 FragColour;
 #define LN_2 0.693147180559945309
 
 // * Uniforms
-uniform bool test;
-uniform float u_time;
+#define MAX_GRADIENT_SIZE 10
 
-uniform bool doGammaCorrection;
-uniform ivec2 resolution;
-uniform sampler2D prevFrameTexture;
+// View and colouring settings, only re-uploaded when they change (mirrored by `Renderer::SettingsBlock`)
+layout(std140, binding = 0) uniform Settings
+{
+    dvec2 centerCoords;
+    dvec2 dimensions;
+    dvec2 scale;
+    dvec2 testDvec2;
+    dvec2 planeCenterX;     // View centre in the plane as double-doubles (hi, lo), for the deep tiers
+    dvec2 planeCenterY;
+    ivec2 resolution;
+
+    int samplingMethod;
+    int samplesPerPixel;
+    int edgeThreshold;
+    int fractalType;
+    int maxFractalIterations;
+    int gradientSize;
+    float gradientDegree;
+    int precisionTier;      // Precision::Tier
+    int referenceLength;    // Points in `referenceOrbit`
+
+    bool test;
+    bool doGammaCorrection;
+    bool doPixelSampling;
+    bool doEdgeDirectedSampling;
+    bool smoothColouring;
+
+    vec4 gradient[MAX_GRADIENT_SIZE];   // vec3 array elements take up a vec4 in std140 anyway
+};
+
+// Perturbation reference orbit of the view centre
+layout(std430, binding = 1) readonly buffer ReferenceOrbit
+{
+    dvec2 referenceOrbit[];
+};
 
+// Per frame state and texture units
+uniform sampler2D prevFrameTexture;
+uniform sampler2D iterationTexture;
 uniform bool doTemporalAntiAliasing;
 uniform int renderedFrameCount;
-
-uniform bool doPixelSampling;
-uniform int samplingMethod;
-uniform int samplesPerPixel;
-
-uniform dvec2 zoomOn_w;
-
-uniform dvec2 centerCoords;
-uniform dvec2 dimensions;
-uniform dvec2 scale;
-uniform dvec2 testDvec2;
-
-uniform int fractalType;
-uniform int maxFractalIterations;
-
-#define MAX_GRADIENT_SIZE 10
-uniform bool smoothColouring;
-uniform int gradientSize;
-uniform vec3 gradient[MAX_GRADIENT_SIZE];
-uniform float gradientDegree;
+uniform bool edgePrepass;
+
+// Specialized variants define these as constants (see `Renderer::shaderDefines()`), the generic program reads the uniforms
+#ifndef FRACTAL_TYPE
+#define FRACTAL_TYPE fractalType
+#endif
+#ifndef SAMPLING_METHOD
+#define SAMPLING_METHOD samplingMethod
+#endif
+#ifndef TEMPORAL_AA
+#define TEMPORAL_AA doTemporalAntiAliasing
+#endif
+#ifndef SMOOTH_COLOURING
+#define SMOOTH_COLOURING smoothColouring
+#endif
+#ifndef TEST
+#define TEST test
+#endif
+#ifndef PRECISION_TIER
+#define PRECISION_TIER precisionTier
+#endif
 
 // * Colour calculation
 vec3 RGBToHSL(vec3 rgb)
@@ -130,23 +180,23 @@ vec3 gradientValue(float a)
     a = pow(a, gradientDegree);
 
     // Calculation breaks down on a == 1.0, so here's a base case
-    if (a == 1.0) return gradient[gradientSize - 1];
+    if (a == 1.0) return gradient[gradientSize - 1].rgb;
 
     // Calculate index of both values and alpha between both values
     float offset = 1.0 / float(gradientSize - 1.0);
     int i = int(a / offset);
     float a1 = (a - i*offset) / offset;
 
-    if (test)
+    if (TEST)
     {
         // No HSL conversion
-        return mix(gradient[i], gradient[i+1], a1);
+        return mix(gradient[i].rgb, gradient[i+1].rgb, a1);
     }
 
     // Linear interpolate both colours based on the alpha value
     // Use HSL for better Hue mixing
-    vec3 hsl1 = RGBToHSL(gradient[i]);
-    vec3 hsl2 = RGBToHSL(gradient[i+1]);
+    vec3 hsl1 = RGBToHSL(gradient[i].rgb);
+    vec3 hsl2 = RGBToHSL(gradient[i+1].rgb);
 
     // Convert to vec3, then linear interpolate, then back to hsl, then to rgb
     vec3 hsl = mix(hsl1, hsl2, a1);
@@ -160,11 +210,11 @@ vec3 colMap(dvec2 z, int iteration)
     {
         float alpha;
         
-        if (smoothColouring)
+        if (SMOOTH_COLOURING)
         {
             float log_zn = log(float(dot(z, z))) / 2.0;
             float nu = log(log_zn / LN_2) / LN_2;
-            float colIndex = float(iteration) + 1.0 - nu;
+            float colIndex = max(float(iteration) + 1.0 - nu, 0.0);
             alpha = sqrt(maxFractalIterations*colIndex) / float(maxFractalIterations);
         }
         else
@@ -181,7 +231,7 @@ vec3 colMap(dvec2 z, int iteration)
 
 // * Fractal generation
 
-int fractalRecurrence(dvec2 z, dvec2 c)
+int fractalRecurrence(inout dvec2 z, dvec2 c)
 {
     int iteration = 0;
     while (dot(z, z) <= 4.0 && iteration < maxFractalIterations)
@@ -193,93 +243,272 @@ int fractalRecurrence(dvec2 z, dvec2 c)
     return iteration;
 }
 
-vec3 mandelbrotSet(dvec2 uv)
+int floatRecurrence(inout vec2 z, vec2 c)
 {
-    dvec2 c = dvec2(uv);
-    dvec2 z = dvec2(0.0);
+    int iteration = 0;
+    while (dot(z, z) <= 4.0 && iteration < maxFractalIterations)
+    {
+        z = vec2(z.x*z.x - z.y*z.y, 2.0*z.x*z.y) + c;
+        iteration++;
+    }
+    return iteration;
+}
 
-    int iteration = fractalRecurrence(z, c);
+void startingPoint(dvec2 uv, out dvec2 z, out dvec2 c)
+{
+    switch (FRACTAL_TYPE)
+    {
+        case 0:  // * MANDELBROT SET
 
-    return colMap(z, iteration);
+            c = uv;
+            z = dvec2(0.0);
+
+        break;
+        case 1:  // * JULIA SET
+
+            z = uv;
+            c = dvec2(-0.5251993);
+
+        break;
+        default:  // * MANDELBROT-JULIA LERP
+
+            c = mix(uv, dvec2(-0.5251993), testDvec2.x);
+            z = mix(dvec2(0.0), uv, testDvec2.y);
+
+        break;
+    }
 }
 
-vec3 juliaSet(dvec2 uv)
+// startingPoint as linear maps, z = uv*zWeight and c = uv*cWeight + cOffset
+void startingWeights(out double zWeight, out double cWeight, out dvec2 cOffset)
 {
-    dvec2 z = dvec2(uv);
-    dvec2 c = dvec2(-0.5251993);
+    dvec2 z;
+    startingPoint(dvec2(0.0), z, cOffset);
+    zWeight = FRACTAL_TYPE == 0 ? 0.0 : FRACTAL_TYPE == 1 ? 1.0 : testDvec2.y;
+    cWeight = FRACTAL_TYPE == 0 ? 1.0 : FRACTAL_TYPE == 1 ? 0.0 : 1.0 - testDvec2.x;
+}
 
-    int iteration = fractalRecurrence(z, c);
+// How far `coord` is from the view centre in the plane, small enough for a double at any depth
+dvec2 planeOffset(vec2 coord)
+{
+    dvec2 offset = dvec2(coord / scale) - dimensions/2.0;
+    offset.y *= resolution.y / double(resolution.x);
+    return offset;
+}
 
-    return colMap(z, iteration);
+// * Double-double arithmetic (mirrored on the CPU in doubleDouble.h), values are dvec2(hi, lo)
+// `precise` keeps the compiler from reassociating or fusing the error-free transformations
+
+dvec2 twoSum(double a, double b)
+{
+    precise double s = a + b;
+    precise double bb = s - a;
+    precise double e = (a - (s - bb)) + (b - bb);
+    return dvec2(s, e);
 }
 
-vec3 mandelbrotJuliaLerp(dvec2 uv)
+dvec2 quickTwoSum(double a, double b)
 {
-    dvec2 c = mix(uv, dvec2(-0.5251993), testDvec2.x);
-    dvec2 z = mix(dvec2(0.0), uv, testDvec2.y);
+    precise double s = a + b;
+    precise double e = b - (s - a);
+    return dvec2(s, e);
+}
 
-    int iteration = fractalRecurrence(z, c);
+// Dekker's splitting rather than fma(), which drivers may implement as a separate multiply and add (llvmpipe does)
+dvec2 twoProduct(double a, double b)
+{
+    const double SPLIT = 134217729.0;  // 2^27 + 1
+    precise double p = a*b;
+    precise double ta = SPLIT*a, tb = SPLIT*b;
+    precise double aHigh = ta - (ta - a), bHigh = tb - (tb - b);
+    precise double aLow = a - aHigh, bLow = b - bHigh;
+    precise double e = ((aHigh*bHigh - p) + aHigh*bLow + aLow*bHigh) + aLow*bLow;
+    return dvec2(p, e);
+}
 
-    return colMap(z, iteration);
+dvec2 ddAdd(dvec2 a, dvec2 b)
+{
+    dvec2 s = twoSum(a.x, b.x);
+    return quickTwoSum(s.x, s.y + a.y + b.y);
 }
 
-vec3 calculateColour(vec2 coord)
+dvec2 ddAdd(dvec2 a, double b)
+{
+    dvec2 s = twoSum(a.x, b);
+    return quickTwoSum(s.x, s.y + a.y);
+}
+
+dvec2 ddMul(dvec2 a, dvec2 b)
+{
+    dvec2 p = twoProduct(a.x, b.x);
+    return quickTwoSum(p.x, p.y + (a.x*b.y + a.y*b.x));
+}
+
+dvec2 ddMul(dvec2 a, double b)
+{
+    dvec2 p = twoProduct(a.x, b);
+    return quickTwoSum(p.x, p.y + a.y*b);
+}
+
+dvec2 ddSqr(dvec2 a)
+{
+    dvec2 p = twoProduct(a.x, a.x);
+    return quickTwoSum(p.x, p.y + 2.0*a.x*a.y);
+}
+
+int doubleDoubleIteration(vec2 coord, out dvec2 z)
+{
+    double zWeight, cWeight;
+    dvec2 cOffset;
+    startingWeights(zWeight, cWeight, cOffset);
+
+    dvec2 offset = planeOffset(coord);
+    dvec2 ux = ddAdd(planeCenterX, offset.x), uy = ddAdd(planeCenterY, offset.y);
+    dvec2 zx = ddMul(ux, zWeight), zy = ddMul(uy, zWeight);
+    dvec2 cx = ddAdd(ddMul(ux, cWeight), cOffset.x), cy = ddAdd(ddMul(uy, cWeight), cOffset.y);
+
+    int iteration = 0;
+    while (iteration < maxFractalIterations)
+    {
+        dvec2 x2 = ddSqr(zx), y2 = ddSqr(zy);
+        if (x2.x + y2.x > 4.0) break;
+
+        dvec2 xy = ddMul(zx, zy);
+        zx = ddAdd(ddAdd(x2, -y2), cx);
+        zy = ddAdd(2.0*xy, cy);
+        iteration++;
+    }
+
+    z = dvec2(zx.x, zy.x);
+    return iteration;
+}
+
+// * Perturbation, the difference to the view centre's orbit (computed on the CPU) in plain doubles
+// Rebases onto the orbit's start whenever z gets closer to zero than to the reference or the reference runs out
+
+int perturbationIteration(vec2 coord, out dvec2 z)
+{
+    double zWeight, cWeight;
+    dvec2 cOffset;
+    startingWeights(zWeight, cWeight, cOffset);
+
+    dvec2 offset = planeOffset(coord);
+    dvec2 dz = offset*zWeight, dc = offset*cWeight;
+
+    int m = 0, iteration = 0, last = referenceLength - 1;
+    z = referenceOrbit[0] + dz;
+    while (dot(z, z) <= 4.0 && iteration < maxFractalIterations)
+    {
+        if (dot(z, z) < dot(dz, dz) || m >= last)
+        {
+            dz = z - referenceOrbit[0];
+            m = 0;
+        }
+
+        // dz_n+1 = (2*Z_n + dz_n)*dz_n + dc
+        dvec2 a = 2.0*referenceOrbit[m] + dz;
+        dz = dvec2(a.x*dz.x - a.y*dz.y, a.x*dz.y + a.y*dz.x) + dc;
+        m++;
+        iteration++;
+        z = referenceOrbit[m] + dz;
+    }
+    return iteration;
+}
+
+int calculateIteration(vec2 coord, out dvec2 z)
 {
+    // Deep tiers work from the double-double view centre, perturbation falls back while there's no reference
+    if (PRECISION_TIER == 3 && referenceLength > 1) return perturbationIteration(coord, z);
+    if (PRECISION_TIER >= 2) return doubleDoubleIteration(coord, z);
+
     // Normalize coords and translate to the desired x, y ranges
     dvec2 uv = dvec2(coord / scale);
     uv += centerCoords - dimensions/2.0;
 
     // Scale to fit aspect ratio
     uv.y *= resolution.y / double(resolution.x);
-    
+
     // Render fractal
-    switch (fractalType)
+    dvec2 c;
+    startingPoint(uv, z, c);
+    if (PRECISION_TIER == 0)
     {
-        case 0:  // * MANDELBROT SET
-        
-            return mandelbrotSet(uv);
-            
-        break;
-        case 1:  // * JULIA SET
-        
-            return juliaSet(uv);
-            
-        break;
-        case 2:  // * MANDELBROT-JULIA LERP
-
-            return mandelbrotJuliaLerp(uv);
-            
-        break;
+        vec2 floatZ = vec2(z);
+        int iteration = floatRecurrence(floatZ, vec2(c));
+        z = dvec2(floatZ);
+        return iteration;
     }
+    return fractalRecurrence(z, c);
 }
 
-// * Utility functions
-float rand()
+vec3 calculateColour(vec2 coord)
+{
+    dvec2 z;
+    int iteration = calculateIteration(coord, z);
+
+    return colMap(z, iteration);
+}
+
+// * Low discrepancy sampling (mirrored on the CPU in sampling.h, keep both in sync)
+
+// R2 sequence increments (1/g, 1/g^2 with g the plastic constant) as 0.32 fixed point
+#define R2_ALPHA_X 0xC13FA9A9u
+#define R2_ALPHA_Y 0x91E10DA6u
+
+uint hash(uint x)
 {
-    return fract(sin(dot(gl_FragCoord.xy, vec2(12.9898, 78.233)) * u_time) * 43758.5453);
+    // Integer avalanche hash (lowbias32)
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
 }
 
+uvec2 pixelScramble(uint stream)
+{
+    // Per-pixel (and per-stream) random rotation so neighbouring pixels don't share sample positions
+    uint h = hash(uint(FRAG_COORD.x) ^ hash(uint(FRAG_COORD.y) ^ hash(stream)));
+    return uvec2(h, hash(h));
+}
+
+vec2 r2Sample(uint index, uint stream)
+{
+    // Cranley-Patterson rotated R2 point in [0, 1)^2, computed in fixed point so it is exact and reproducible
+    uvec2 point = uvec2(index * R2_ALPHA_X, index * R2_ALPHA_Y) + pixelScramble(stream);
+    return vec2(point >> 8u) / 16777216.0;
+}
+
+// * Utility functions
+
 vec3 gammaCorrect(vec3 linear)
 {
     return vec3(sqrt(linear.x), sqrt(linear.y), sqrt(linear.z));
 }
 
-vec3 postProcess(vec3 colour)
+vec4 postProcess(vec3 colour, float sampleCount)
 {
 
     if (doGammaCorrection)
     {
         colour = gammaCorrect(colour);
     }
+
+    // Weight the colour by the number of samples it averages, alpha holds the sample count
+    vec4 accumulated = vec4(colour * sampleCount, sampleCount);
     
-    if (doTemporalAntiAliasing)
+    if (TEMPORAL_AA)
     {
-        // Average colour with previous frame
-        vec3 prevColour = texture(prevFrameTexture, TexCoords).xyz;
-        colour = mix(prevColour, colour, 1.0 / (renderedFrameCount + 1));
+        // Add to the sums accumulated over previous frames
+#ifdef COMPUTE_SHADER
+        accumulated += imageLoad(accumulationImage, ivec2(FRAG_COORD));
+#else
+        accumulated += texelFetch(prevFrameTexture, ivec2(FRAG_COORD), 0);
+#endif
     }
 
-    return colour;
+    return accumulated;
 
 }
 
@@ -287,12 +516,12 @@ vec3 postProcess(vec3 colour)
 vec3 randomPointSample()
 {
     vec3 colour = vec3(0.0);
-    vec2 pixelCenter = gl_FragCoord.xy + 0.5;
+    vec2 pixelCenter = FRAG_COORD + 0.5;
 
     for (int i = 0; i < samplesPerPixel; i++)
     {
-        // Sample random window coords
-        vec2 offset = vec2(rand() - 0.5, rand() - 0.5);
+        // Sample window coords from the pixel's low discrepancy sequence, continuing where the last frame left off
+        vec2 offset = r2Sample(uint(renderedFrameCount*samplesPerPixel + i), 0u) - 0.5;
         vec2 sampledCoord = pixelCenter + offset;
 
         // Calculate colour
@@ -312,7 +541,7 @@ vec3 gridSample()
         {
             // Sample random window coords
             vec2 offset = (vec2(i, j) + 0.5) / float(samplesPerPixel);
-            vec2 sampledCoord = gl_FragCoord.xy + offset;
+            vec2 sampledCoord = FRAG_COORD + offset;
 
             // Calculate colour
             colour += calculateColour(sampledCoord);
@@ -330,9 +559,10 @@ vec3 jitteredGridSample()
     {
         for (int j = 0; j < samplesPerPixel; j++)
         {
-            // Sample random window coords with jitter
-            vec2 offset = (vec2(i, j) + vec2(rand(), rand())) / float(samplesPerPixel);
-            vec2 sampledCoord = gl_FragCoord.xy + offset;
+            // Sample window coords with jitter, each cell follows its own low discrepancy sequence across frames
+            vec2 jitter = r2Sample(uint(renderedFrameCount), uint(i*samplesPerPixel + j + 1));
+            vec2 offset = (vec2(i, j) + jitter) / float(samplesPerPixel);
+            vec2 sampledCoord = FRAG_COORD + offset;
 
             // Calculate colour
             colour += calculateColour(sampledCoord);
@@ -342,27 +572,97 @@ vec3 jitteredGridSample()
     return colour / float(samplesPerPixel*samplesPerPixel);
 }
 
-void main()
+// * Edge detection
+bool isEdgePixel()
+{
+    // Compare the prepass iteration counts of the 3x3 neighbourhood
+    ivec2 pixel = ivec2(FRAG_COORD);
+    float minIteration = FLOAT_MAX, maxIteration = 0.0;
+
+    for (int i = -1; i <= 1; i++)
+    {
+        for (int j = -1; j <= 1; j++)
+        {
+            ivec2 neighbour = clamp(pixel + ivec2(i, j), ivec2(0), resolution - 1);
+            float iteration = texelFetch(iterationTexture, neighbour, 0).r;
+            minIteration = min(minIteration, iteration);
+            maxIteration = max(maxIteration, iteration);
+        }
+    }
+
+    return maxIteration - minIteration > float(edgeThreshold);
+}
+
+vec4 prepassPixel()
 {
+    // One sample per pixel, the iteration count for edge detection
+    dvec2 z;
+    int iteration = calculateIteration(FRAG_COORD + 0.5, z);
+    return vec4(float(iteration), 0.0, 0.0, 1.0);
+}
 
+vec4 samplePixel()
+{
     vec3 currentColour;
+    float sampleCount = 1.0;
 
-    if (doTemporalAntiAliasing || doPixelSampling)
+    if ((TEMPORAL_AA || doPixelSampling) && doEdgeDirectedSampling && !isEdgePixel())
+    {
+        // Flat region, a single sample is enough and further frames would only repeat it
+        if (TEMPORAL_AA)
+        {
+            currentColour = vec3(0.0);
+            sampleCount = 0.0;
+        }
+        else
+        {
+            currentColour = calculateColour(FRAG_COORD + 0.5);
+        }
+    }
+    else if (TEMPORAL_AA || doPixelSampling)
     {
         // Sample pixel based on some sampling method
-        if (samplingMethod == 0)
+        if (SAMPLING_METHOD == 0)
+        {
             currentColour = randomPointSample();
-        else if (samplingMethod == 1)
+            sampleCount = float(samplesPerPixel);
+        }
+        else if (SAMPLING_METHOD == 1)
+        {
             currentColour = jitteredGridSample();
-        else if (samplingMethod == 2)
+            sampleCount = float(samplesPerPixel*samplesPerPixel);
+        }
+        else if (SAMPLING_METHOD == 2)
+        {
             currentColour = gridSample();
+            sampleCount = float(samplesPerPixel*samplesPerPixel);
+        }
     }
     else
     {
         // No sampling, calculate colour at the pixel's center
-        currentColour = calculateColour(gl_FragCoord.xy + 0.5);
+        currentColour = calculateColour(FRAG_COORD + 0.5);
     }
 
-    currentColour = postProcess(currentColour);
-    FragColour = vec4(currentColour, 1.0);
-}
\ No newline at end of file
+    return postProcess(currentColour, sampleCount);
+}
+
+#ifdef COMPUTE_SHADER
+void main()
+{
+    // Tiles are rounded up to whole work groups, skip the invocations past the tile's edge
+    ivec2 pixel = tileOrigin + ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(pixel, tileEnd))) return;
+
+    // Pixel centres, like gl_FragCoord
+    fragCoord = vec2(pixel) + 0.5;
+
+    if (edgePrepass) imageStore(iterationImage, pixel, prepassPixel());
+    else imageStore(accumulationImage, pixel, samplePixel());
+}
+#else
+void main()
+{
+    FragColour = edgePrepass ? prepassPixel() : samplePixel();
+}
+#endif
\ No newline at end of file
@@ -1,12 +1,70 @@
-#version 460 core
+#version 450 core
 
 in vec2 TexCoords;
 
 out vec4 FragColor;
 
 uniform sampler2D finalTexture;
+uniform sampler2D iterationTexture;
+
+// Edge-aware denoiser (mirrored on the CPU in denoise.h, keep both in sync)
+uniform bool doDenoise;
+uniform int denoiseRadius;
+uniform float denoiseColourSigma;
+uniform float denoiseIterationSigma;
+uniform float denoiseFadeFrames;
+uniform int renderedFrameCount;
+
+vec3 resolve(vec4 accumulated)
+{
+    // RGB is the sum of all accumulated samples and alpha is the sample count
+    return accumulated.rgb / max(accumulated.a, 1.0);
+}
+
+vec3 jointBilateral(ivec2 pixel, vec3 centreColour)
+{
+    ivec2 size = textureSize(finalTexture, 0);
+    float centreIteration = texelFetch(iterationTexture, pixel, 0).r;
+    float spatialSigma = max(denoiseRadius / 2.0, 0.5);
+
+    vec3 colourSum = vec3(0.0);
+    float weightSum = 0.0;
+
+    for (int j = -denoiseRadius; j <= denoiseRadius; j++)
+    {
+        for (int i = -denoiseRadius; i <= denoiseRadius; i++)
+        {
+            ivec2 neighbour = clamp(pixel + ivec2(i, j), ivec2(0), size - 1);
+
+            vec3 colour = resolve(texelFetch(finalTexture, neighbour, 0));
+            float iterationDelta = texelFetch(iterationTexture, neighbour, 0).r - centreIteration;
+            vec3 colourDelta = colour - centreColour;
+
+            // Spatial falloff, stop at iteration band edges and strong colour changes
+            float weight = exp(-(i*i + j*j) / (2.0*spatialSigma*spatialSigma))
+                * exp(-(iterationDelta*iterationDelta) / (2.0*denoiseIterationSigma*denoiseIterationSigma))
+                * exp(-dot(colourDelta, colourDelta) / (2.0*denoiseColourSigma*denoiseColourSigma));
+
+            colourSum += colour*weight;
+            weightSum += weight;
+        }
+    }
+
+    return colourSum / weightSum;
+}
 
 void main()
 {
-    FragColor = texture(finalTexture, TexCoords);
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 accumulated = texelFetch(finalTexture, pixel, 0);
+    vec3 colour = resolve(accumulated);
+
+    if (doDenoise)
+    {
+        // Fade the filter out as frames accumulate (not samples, edge-directed sampling keeps flat pixels at one)
+        vec3 denoised = jointBilateral(pixel, colour);
+        colour = mix(denoised, colour, clamp(renderedFrameCount / denoiseFadeFrames, 0.0, 1.0));
+    }
+
+    FragColor = vec4(colour, 1.0);
 }
@@ -0,0 +1,360 @@
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <list>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <filesystem>
+#include <unordered_map>
+#include <condition_variable>
+#include <glm/glm.hpp>
+
+// Two tier cache of finished CPU engine tiles, content addressed by a hash of everything that affects their pixels
+// Recently used tiles stay in memory, every stored tile is also written to disk (one file each, on a background thread)
+// so the cache survives restarts. Both tiers evict least recently used tiles once over their byte budget
+// The viewer only turns it on when asked to ("Cache tiles"), its files go in the user's cache directory
+class TileCache
+{
+public:
+
+    struct Entry
+    {
+        int passes = 0;
+        int width = 0, height = 0;
+        std::vector<glm::vec4> accumulation;
+        std::vector<float> iterations;
+
+        size_t bytes() const { return accumulation.size()*sizeof(glm::vec4) + iterations.size()*sizeof(float); }
+    };
+
+    struct Stats
+    {
+        uint64_t memoryHits = 0, diskHits = 0, misses = 0;
+        size_t memoryBytes = 0, diskBytes = 0;
+        int memoryTiles = 0, diskTiles = 0;
+    };
+
+    // Per user cache directory (XDG_CACHE_HOME, ~/.cache or LOCALAPPDATA), the working directory only when there's none
+    static std::string defaultDirectory()
+    {
+        const char *base = getenv("XDG_CACHE_HOME");
+        std::string suffix = "/fractals/tiles";
+        if (!base || !*base)
+        {
+            base = getenv("HOME");
+            suffix = "/.cache" + suffix;
+        }
+#ifdef _WIN32
+        if (!base || !*base)
+        {
+            base = getenv("LOCALAPPDATA");
+            suffix = "/fractals/tiles";
+        }
+#endif
+        return base && *base ? base + suffix : "tileCache";
+    }
+
+    TileCache(const std::string &cacheDirectory, size_t memoryBudgetBytes, size_t diskBudgetBytes)
+        : directory(cacheDirectory), memoryBudget(memoryBudgetBytes), diskBudget(diskBudgetBytes)
+    {
+        scanDirectory();
+        writer = std::thread(&TileCache::writerLoop, this);
+    }
+
+    ~TileCache()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        writer.join();
+    }
+
+    bool get(uint64_t key, Entry &entry)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        auto inMemory = memoryIndex.find(key);
+        if (inMemory != memoryIndex.end())
+        {
+            memory.splice(memory.begin(), memory, inMemory->second);
+            std::shared_ptr<const Entry> found = inMemory->second->second;
+            stats.memoryHits++;
+            lock.unlock();
+
+            entry = *found;
+            return true;
+        }
+
+        auto onDisk = diskIndex.find(key);
+        if (onDisk == diskIndex.end())
+        {
+            stats.misses++;
+            return false;
+        }
+        disk.splice(disk.begin(), disk, onDisk->second);
+        lock.unlock();
+
+        // Read outside the lock, then promote to the memory tier
+        bool ok = readTile(key, entry);
+        lock.lock();
+        if (!ok)
+        {
+            stats.misses++;
+            return false;
+        }
+        stats.diskHits++;
+        insertMemory(key, std::make_shared<const Entry>(entry));
+        return true;
+    }
+
+    void put(uint64_t key, const Entry &entry)
+    {
+        std::shared_ptr<const Entry> stored = std::make_shared<const Entry>(entry);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        insertMemory(key, stored);
+        writeQueue.push_back({ key, stored });
+        wake.notify_one();
+    }
+
+    void setBudgets(size_t memoryBudgetBytes, size_t diskBudgetBytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        memoryBudget = memoryBudgetBytes;
+        diskBudget = diskBudgetBytes;
+        evictMemory();
+        evictDisk();
+    }
+
+    // Tiles the writer is in the middle of writing are deleted once they're done, rather than indexed
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        clears++;
+        memory.clear();
+        memoryIndex.clear();
+        stats.memoryBytes = 0;
+        writeQueue.clear();
+
+        while (!disk.empty()) removeOldestDiskTile();
+        stats.memoryHits = stats.diskHits = stats.misses = 0;
+    }
+
+    Stats statistics()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Stats current = stats;
+        current.memoryTiles = (int)memory.size();
+        current.diskTiles = (int)disk.size();
+        return current;
+    }
+
+private:
+
+    struct DiskHeader
+    {
+        char magic[8];
+        uint32_t version;
+        int32_t passes, width, height;
+        uint64_t key;
+    };
+
+    typedef std::list<std::pair<uint64_t, std::shared_ptr<const Entry>>> MemoryList;
+    typedef std::list<std::pair<uint64_t, size_t>> DiskList;
+
+    std::string directory;
+    std::thread writer;
+
+    // Guarded by `mutex`, lists are most recently used first
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    int clears = 0;
+    size_t memoryBudget, diskBudget;
+    MemoryList memory;
+    std::unordered_map<uint64_t, MemoryList::iterator> memoryIndex;
+    DiskList disk;
+    std::unordered_map<uint64_t, DiskList::iterator> diskIndex;
+    std::deque<std::pair<uint64_t, std::shared_ptr<const Entry>>> writeQueue;
+    Stats stats;
+
+    std::string path(uint64_t key) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.tile", (unsigned long long)key);
+        return directory + "/" + name;
+    }
+
+    void insertMemory(uint64_t key, std::shared_ptr<const Entry> entry)
+    {
+        auto existing = memoryIndex.find(key);
+        if (existing != memoryIndex.end())
+        {
+            stats.memoryBytes -= existing->second->second->bytes();
+            memory.erase(existing->second);
+        }
+
+        memory.push_front({ key, entry });
+        memoryIndex[key] = memory.begin();
+        stats.memoryBytes += entry->bytes();
+        evictMemory();
+    }
+
+    void evictMemory()
+    {
+        // Everything in memory has been (or is about to be) written to disk, so dropping it is enough
+        while (stats.memoryBytes > memoryBudget && !memory.empty())
+        {
+            stats.memoryBytes -= memory.back().second->bytes();
+            memoryIndex.erase(memory.back().first);
+            memory.pop_back();
+        }
+    }
+
+    void evictDisk()
+    {
+        while (stats.diskBytes > diskBudget && !disk.empty()) removeOldestDiskTile();
+    }
+
+    void removeOldestDiskTile()
+    {
+        std::error_code error;
+        std::filesystem::remove(path(disk.back().first), error);
+        stats.diskBytes -= disk.back().second;
+        diskIndex.erase(disk.back().first);
+        disk.pop_back();
+    }
+
+    // Picks up tiles written by earlier runs, oldest first so the most recent end up at the front
+    void scanDirectory()
+    {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+
+        std::vector<std::pair<std::filesystem::file_time_type, std::pair<uint64_t, size_t>>> found;
+        for (const auto &file : std::filesystem::directory_iterator(directory, error))
+        {
+            std::string name = file.path().filename().string();
+            unsigned long long key;
+            if (file.path().extension() != ".tile" || sscanf(name.c_str(), "%16llx", &key) != 1) continue;
+            found.push_back({ file.last_write_time(error), { (uint64_t)key, (size_t)file.file_size(error) } });
+        }
+        std::sort(found.begin(), found.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+
+        for (const auto &tile : found)
+        {
+            disk.push_front(tile.second);
+            diskIndex[tile.second.first] = disk.begin();
+            stats.diskBytes += tile.second.second;
+        }
+        evictDisk();
+    }
+
+    bool readTile(uint64_t key, Entry &entry)
+    {
+        FILE *file = fopen(path(key).c_str(), "rb");
+        if (!file) return false;
+
+        DiskHeader header;
+        bool ok = fread(&header, sizeof(header), 1, file) == 1
+            && memcmp(header.magic, "FRACTILE", 8) == 0 && header.version == 1 && header.key == key
+            && header.width > 0 && header.height > 0 && header.width*header.height <= 1 << 20;
+        if (ok)
+        {
+            size_t pixels = (size_t)header.width*header.height;
+            entry.passes = header.passes;
+            entry.width = header.width;
+            entry.height = header.height;
+            entry.accumulation.resize(pixels);
+            entry.iterations.resize(pixels);
+            ok = fread(entry.accumulation.data(), sizeof(glm::vec4), pixels, file) == pixels
+                && fread(entry.iterations.data(), sizeof(float), pixels, file) == pixels;
+        }
+        fclose(file);
+        return ok;
+    }
+
+    bool writeTile(uint64_t key, const Entry &entry, size_t &size)
+    {
+        DiskHeader header;
+        memcpy(header.magic, "FRACTILE", 8);
+        header.version = 1;
+        header.passes = entry.passes;
+        header.width = entry.width;
+        header.height = entry.height;
+        header.key = key;
+
+        // Write to a temporary name first so a crash never leaves a torn tile behind
+        std::string finalPath = path(key), temporaryPath = finalPath + ".part";
+        FILE *file = fopen(temporaryPath.c_str(), "wb");
+        if (!file) return false;
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+            && fwrite(entry.accumulation.data(), sizeof(glm::vec4), entry.accumulation.size(), file) == entry.accumulation.size()
+            && fwrite(entry.iterations.data(), sizeof(float), entry.iterations.size(), file) == entry.iterations.size();
+        ok &= fclose(file) == 0;
+
+        std::error_code error;
+        if (ok) std::filesystem::rename(temporaryPath, finalPath, error);
+        if (!ok || error)
+        {
+            std::filesystem::remove(temporaryPath, error);
+            return false;
+        }
+
+        size = sizeof(header) + entry.bytes();
+        return true;
+    }
+
+    void writerLoop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            wake.wait(lock, [this] { return stopping || !writeQueue.empty(); });
+            if (writeQueue.empty()) return;
+
+            // Finish writing what's queued even when stopping, that's what makes the cache persistent
+            std::pair<uint64_t, std::shared_ptr<const Entry>> tile = writeQueue.front();
+            writeQueue.pop_front();
+            int clearsBefore = clears;
+            lock.unlock();
+
+            size_t size;
+            bool ok = writeTile(tile.first, *tile.second, size);
+
+            lock.lock();
+            if (!ok) continue;
+            if (clears != clearsBefore)
+            {
+                // Cleared while writing, a copy stored since is still queued and writes the file again
+                std::error_code error;
+                std::filesystem::remove(path(tile.first), error);
+                continue;
+            }
+
+            auto existing = diskIndex.find(tile.first);
+            if (existing != diskIndex.end())
+            {
+                stats.diskBytes -= existing->second->second;
+                disk.erase(existing->second);
+            }
+            disk.push_front({ tile.first, size });
+            diskIndex[tile.first] = disk.begin();
+            stats.diskBytes += size;
+            evictDisk();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <glad/glad.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "cpuRenderer.h"
+
+// Hands out a pass worth of GPU tiles a few at a time, as many per frame as fit in a time budget
+// The cost of a tile comes from timer queries around earlier frames' dispatches, read back a frame or two late so
+// nothing waits on the GPU, and tiles that don't fit stay queued for the next frame
+class TileScheduler
+{
+public:
+
+    static constexpr int TILE_SIZE = 64;
+    static constexpr int QUERY_COUNT = 4;
+
+    void init()
+    {
+        glGenQueries(QUERY_COUNT, queries);
+    }
+
+    // Queues every tile of `resolution` again, the ones nearest `focus` first
+    void restart(glm::ivec2 resolution, glm::vec2 focus)
+    {
+        tiles.clear();
+        for (int y = 0; y < resolution.y; y += TILE_SIZE)
+        {
+            for (int x = 0; x < resolution.x; x += TILE_SIZE)
+            {
+                tiles.push_back({ x, y, std::min(TILE_SIZE, resolution.x - x), std::min(TILE_SIZE, resolution.y - y) });
+            }
+        }
+
+        auto distance = [focus](const Tile &tile)
+        {
+            glm::vec2 delta = glm::vec2(tile.x + tile.width / 2.0f, tile.y + tile.height / 2.0f) - focus;
+            return std::max(fabsf(delta.x), fabsf(delta.y));
+        };
+        std::stable_sort(tiles.begin(), tiles.end(), [&](const Tile &a, const Tile &b) { return distance(a) < distance(b); });
+
+        nextTile = 0;
+    }
+
+    // Starts the queue over for another pass over the same tiles
+    void nextPass()
+    {
+        nextTile = 0;
+    }
+
+    bool passDone() const { return nextTile >= (int)tiles.size(); }
+    int tileCount() const { return (int)tiles.size(); }
+    int tilesDone() const { return nextTile; }
+    int lastFrameTiles() const { return frameTiles; }
+    double msPerTile() const { return tileMs; }
+
+    // Calls `f(tile)` for the next tiles of the pass that should fit in `budgetMs`, returns how many
+    template <typename F>
+    int dispatch(double budgetMs, F f)
+    {
+        collectTimings();
+        if (passDone()) return 0;
+
+        // Without a measurement yet start with a single tile, and never more than double the last frame's count so
+        // moving from cheap tiles onto expensive ones can't blow through the budget on a stale estimate
+        int count = tileMs > 0.0 ? (int)(budgetMs / tileMs) : 1;
+        count = std::min(count, std::max(1, frameTiles*2));
+        count = std::max(1, std::min(count, (int)tiles.size() - nextTile));
+
+        // Every query in flight means the frame goes unmeasured, the estimate is only a frame older for it
+        int query = freeQuery();
+        if (query >= 0) glBeginQuery(GL_TIME_ELAPSED, queries[query]);
+        for (int i = 0; i < count; i++) f(tiles[nextTile++]);
+        if (query >= 0)
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            queryTiles[query] = count;
+        }
+
+        frameTiles = count;
+        return count;
+    }
+
+private:
+
+    std::vector<Tile> tiles;
+    int nextTile = 0;
+    int frameTiles = 0;
+    double tileMs = 0.0;
+
+    GLuint queries[QUERY_COUNT];
+    int queryTiles[QUERY_COUNT] = {};  // Tiles measured by each query, 0 when it isn't in flight
+
+    int freeQuery() const
+    {
+        for (int i = 0; i < QUERY_COUNT; i++) if (queryTiles[i] == 0) return i;
+        return -1;
+    }
+
+    void collectTimings()
+    {
+        for (int i = 0; i < QUERY_COUNT; i++)
+        {
+            if (queryTiles[i] == 0) continue;
+
+            GLint available = 0;
+            glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) continue;
+
+            // Smoothed, neighbouring tiles cost about the same but single frames are noisy
+            GLuint64 elapsed;
+            glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed);
+            double sample = elapsed / 1e6 / queryTiles[i];
+            tileMs = tileMs > 0.0 ? 0.7*tileMs + 0.3*sample : sample;
+            queryTiles[i] = 0;
+        }
+    }
+};
+
+#endif
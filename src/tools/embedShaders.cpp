@@ -0,0 +1,70 @@
+// Writes shader sources into a header as raw string literals, so the viewer doesn't need `src/shaders` at runtime
+// Usage: embedShaders <output header> <shader files...>
+// The header is only rewritten when its contents change, so unchanged shaders don't trigger a rebuild
+
+#include <stdio.h>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <filesystem>
+
+static bool readFile(const char *path, std::string &contents)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    std::stringstream stream;
+    stream << file.rdbuf();
+    contents = stream.str();
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: embedShaders <output header> <shader files...>" << std::endl;
+        return 1;
+    }
+
+    std::string header =
+        "// Generated by embedShaders from the files in src/shaders, do not edit\n"
+        "#ifndef EMBEDDED_SHADERS_H\n"
+        "#define EMBEDDED_SHADERS_H\n\n"
+        "struct EmbeddedShader { const char *path; const char *source; };\n\n"
+        "static const EmbeddedShader embeddedShaders[] = {\n";
+
+    for (int i = 2; i < argc; i++)
+    {
+        std::string source;
+        if (!readFile(argv[i], source))
+        {
+            std::cerr << "Error: could not read `" << argv[i] << "`" << std::endl;
+            return 1;
+        }
+        if (source.find(")glsl\"") != std::string::npos)
+        {
+            std::cerr << "Error: `" << argv[i] << "` contains the raw string delimiter" << std::endl;
+            return 1;
+        }
+
+        header += "    { \"" + std::string(argv[i]) + "\", R\"glsl(" + source + ")glsl\" },\n";
+    }
+    header += "};\n\n#endif\n";
+
+    std::string existing;
+    if (readFile(argv[1], existing) && existing == header) return 0;
+
+    std::error_code error;
+    std::filesystem::path output(argv[1]);
+    if (output.has_parent_path()) std::filesystem::create_directories(output.parent_path(), error);
+
+    FILE *file = fopen(argv[1], "wb");
+    if (!file || fwrite(header.data(), 1, header.size(), file) != header.size() || fclose(file) != 0)
+    {
+        std::cerr << "Error: could not write `" << argv[1] << "`" << std::endl;
+        return 1;
+    }
+    return 0;
+}
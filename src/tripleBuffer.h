@@ -0,0 +1,53 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// Hands the newest of a stream of values from one producer thread to one consumer thread, without locks or waiting
+// The producer fills its back slot and swaps it with the middle one, the consumer swaps its front slot with the middle
+// one whenever that holds something newer, so neither ever touches a slot the other one is using
+template <typename T>
+class TripleBuffer
+{
+public:
+
+    // * Producer
+
+    T &back() { return slots[backIndex]; }
+
+    void publish()
+    {
+        backIndex = middle.exchange(backIndex | FRESH) & INDEX;
+    }
+
+    // Whether the last published value is still waiting for the consumer
+    bool pending() const
+    {
+        return (middle.load() & FRESH) != 0;
+    }
+
+    // * Consumer
+
+    // Moves on to the newest published value, false if nothing was published since the last call
+    bool update()
+    {
+        if (!pending()) return false;
+        frontIndex = middle.exchange(frontIndex) & INDEX;
+        return true;
+    }
+
+    T &front() { return slots[frontIndex]; }
+
+    // Any slot, only while neither thread is using the buffer
+    T &slot(int i) { return slots[i]; }
+
+private:
+
+    static constexpr int INDEX = 3, FRESH = 4;
+
+    T slots[3] = {};
+    int backIndex = 0, frontIndex = 1;
+    std::atomic<int> middle { 2 };
+};
+
+#endif
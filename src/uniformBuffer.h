@@ -0,0 +1,47 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+
+// Uniform buffer holding a std140 block that `T` mirrors member for member, bound to a fixed binding point
+// Change `data` and mark it dirty, `upload()` only touches the buffer when something changed since the last one
+template <typename T>
+class UniformBuffer
+{
+public:
+
+    T data = {};
+
+    void init(GLuint bindingPoint)
+    {
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, ID);
+        dirty = true;
+    }
+
+    void markDirty() { dirty = true; }
+    bool isDirty() const { return dirty; }
+    int uploadCount() const { return uploads; }
+
+    void upload()
+    {
+        if (!dirty) return;
+
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        dirty = false;
+        uploads++;
+    }
+
+private:
+
+    GLuint ID = 0;
+    bool dirty = true;
+    int uploads = 0;
+};
+
+#endif
@@ -1,8 +1,46 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stdint.h>
+#include <stddef.h>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
 #define PI 3.14159265358979323846
 
+// FNV-1a, for cache keys and fingerprints, longer keys chain calls through `seed`
+constexpr uint64_t HASH_SEED = 14695981039346656037ull;
+
+inline uint64_t hashBytes(const void *data, size_t size, uint64_t seed = HASH_SEED)
+{
+    const uint8_t *bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++) seed = (seed ^ bytes[i])*1099511628211ull;
+    return seed;
+}
+
+template <typename T>
+uint64_t hashValue(const T &value, uint64_t seed = HASH_SEED)
+{
+    return hashBytes(&value, sizeof(T), seed);
+}
+
+// Calls `f(firstRow, lastRow)` on `threadCount` threads, interleaving blocks of rows so expensive areas are shared out
+template <typename F>
+void parallelRows(int height, int threadCount, F f)
+{
+    const int BLOCK = 16;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&, t]
+        {
+            for (int y = t*BLOCK; y < height; y += threadCount*BLOCK) f(y, std::min(y + BLOCK, height));
+        });
+    }
+    for (std::thread &thread : threads) thread.join();
+}
+
 class Interval
 {
 public:
@@ -2,7 +2,8 @@
 #define WINDOW_H
 
 #include <glad/glad.h>
-#include <GLFW/glfw3.h>
+#include <iostream>
+#include <glm/glm.hpp>
 
 class Window
 {
@@ -11,6 +12,8 @@ public:
     int width, height;
     double aspectRatio;
     GLuint textures[2], FBOs[2];
+    GLuint displayTexture, displayFBO;
+    GLuint iterationTexture, iterationFBO;
 
     Window () {}
 
@@ -30,11 +33,10 @@ public:
         // Update texture sizes
         for (int i = 0; i < 2; i++)
         {
-            glBindTexture(GL_TEXTURE_2D, textures[i]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            allocateAccumulationTexture(textures[i]);
         }
+        allocateDisplayTexture(displayTexture);
+        allocateIterationTexture(iterationTexture);
         glBindTexture(GL_TEXTURE_2D, 0);
     }
 
@@ -54,24 +56,63 @@ private:
         for (int i = 0; i < 2; i++)
         {
             // Set texture parameters
-            glBindTexture(GL_TEXTURE_2D, textures[i]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            allocateAccumulationTexture(textures[i]);
             
             // Attach textures to FBOs
-            glBindFramebuffer(GL_FRAMEBUFFER, FBOs[i]);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[i], 0);
-
-            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-                std::cerr << "Frame buffer not complete" << std::endl;
+            attachTexture(FBOs[i], textures[i]);
         }
+
+        // 8-bit texture the accumulated samples get resolved into for display
+        glGenFramebuffers(1, &displayFBO);
+        glGenTextures(1, &displayTexture);
+        allocateDisplayTexture(displayTexture);
+        attachTexture(displayFBO, displayTexture);
+
+        // Single sample iteration counts used to find edges for edge-directed sampling
+        glGenFramebuffers(1, &iterationFBO);
+        glGenTextures(1, &iterationTexture);
+        allocateIterationTexture(iterationTexture);
+        attachTexture(iterationFBO, iterationTexture);
         
         // Unbind texture and frame buffers
         glBindTexture(GL_TEXTURE_2D, 0);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
+    void allocateAccumulationTexture(GLuint texture)
+    {
+        // RGB holds the sum of every colour sample taken for the pixel, alpha holds the sample count
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    void allocateDisplayTexture(GLuint texture)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    void allocateIterationTexture(GLuint texture)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    void attachTexture(GLuint FBO, GLuint texture)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Frame buffer not complete" << std::endl;
+    }
+
 };
 
 #endif
\ No newline at end of file